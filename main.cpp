@@ -27,6 +27,15 @@
 #include <thread>
 #include <utility>
 #include <cstdlib> // For abort().
+#include <cerrno>
+
+#ifdef HAVE_SETPRIORITY
+#include <sys/resource.h> // For setpriority().
+#endif
+#if HAVE_DECL_SYS_IOPRIO_SET
+#include <sys/syscall.h>
+#include <unistd.h> // For syscall().
+#endif
 
 #include "sync_queue_impl_selector.h"
 #include "ArgParse.h"
@@ -38,6 +47,33 @@
 #include "OutputTask.h"
 
 
+/**
+ * Drop the calling thread to the lowest CPU priority and, on Linux, the idle I/O scheduling class.  Threads created
+ * afterwards inherit both.  Failures are logged and otherwise ignored.
+ */
+static void SetBackgroundPriority()
+{
+#ifdef HAVE_SETPRIORITY
+	errno = 0;
+	if(setpriority(PRIO_PROCESS, 0, 19) != 0)
+	{
+		LOG(INFO) << "setpriority() failed: " << LOG_STRERROR();
+		errno = 0;
+	}
+#endif
+#if HAVE_DECL_SYS_IOPRIO_SET
+	// From the kernel's include/uapi/linux/ioprio.h, which not all distros ship.
+	constexpr int ioprio_who_process = 1;
+	constexpr int ioprio_class_idle = 3;
+	constexpr int ioprio_class_shift = 13;
+	if(syscall(SYS_ioprio_set, ioprio_who_process, 0, ioprio_class_idle << ioprio_class_shift) != 0)
+	{
+		LOG(INFO) << "ioprio_set() failed: " << LOG_STRERROR();
+		errno = 0;
+	}
+#endif
+}
+
 int main(int argc, char **argv)
 {
 	try
@@ -65,6 +101,14 @@ int main(int argc, char **argv)
 
 		LOG(INFO) << "Num scanner jobs: " << arg_parser.m_jobs;
 
+		FileID::SetDirDescriptorCacheCapacity(arg_parser.m_dir_fd_cache_size);
+
+		if(arg_parser.m_background)
+		{
+			// Do this before starting any threads, so that they all inherit it.
+			SetBackgroundPriority();
+		}
+
 		// Create the Globber->FileScanner queue.
 		sync_queue<std::shared_ptr<FileID>> files_to_scan_queue;
 
@@ -73,13 +117,33 @@ int main(int argc, char **argv)
 
 		// Set up the globber.
 		Globber globber(arg_parser.m_paths, type_manager, dir_inclusion_manager, arg_parser.m_recurse, arg_parser.m_follow_symlinks,
-				arg_parser.m_dirjobs, files_to_scan_queue);
+				arg_parser.m_dirjobs, arg_parser.m_read_order, files_to_scan_queue);
 
 		// Set up the output task object.
-		OutputTask output_task(arg_parser.m_color, arg_parser.m_nocolor, arg_parser.m_column, match_queue);
+		OutputTask output_task(arg_parser.m_color, arg_parser.m_nocolor, arg_parser.m_column,
+				arg_parser.m_files_with_matches || arg_parser.m_files_without_match, match_queue);
 
 		// Create the FileScanner object.
-		std::unique_ptr<FileScanner> file_scanner(FileScanner::Create(files_to_scan_queue, match_queue, arg_parser.m_pattern, arg_parser.m_ignore_case, arg_parser.m_word_regexp, arg_parser.m_pattern_is_literal));
+		ScannerOptions scanner_options {
+			.patterns = arg_parser.m_patterns,
+			.pattern_numbers = arg_parser.m_pattern_numbers,
+			.ignore_case = arg_parser.m_ignore_case,
+			.word_regexp = arg_parser.m_word_regexp,
+			.pattern_is_literal = arg_parser.m_pattern_is_literal,
+			.use_mmap = arg_parser.m_use_mmap,
+			.scan_window_size = arg_parser.m_scan_window_size,
+			.max_filesize = arg_parser.m_max_filesize,
+			.search_binary = arg_parser.m_search_binary,
+			.search_minified = arg_parser.m_search_minified,
+			.files_with_matches = arg_parser.m_files_with_matches,
+			.files_without_match = arg_parser.m_files_without_match,
+			.drop_from_page_cache = arg_parser.m_background,
+			.max_read_rate = arg_parser.m_max_read_rate,
+			.match_limit = arg_parser.m_match_limit,
+			.match_time_limit = arg_parser.m_match_time_limit,
+			.engine = arg_parser.m_use_libhs ? RegexEngine::HYPERSCAN : RegexEngine::DEFAULT,
+		};
+		std::unique_ptr<FileScanner> file_scanner(FileScanner::Create(files_to_scan_queue, match_queue, scanner_options));
 
 		// Start the output task thread.
 		std::thread output_task_thread {&OutputTask::Run, &output_task};
@@ -39,6 +39,7 @@
 #include <sstream>
 #include <system_error>
 #include <cstdlib>
+#include <cerrno>
 #include <cstring>
 #include <cstdio>
 
@@ -57,9 +58,13 @@ namespace lmcppop = lmcppop_int::option;
 #if HAVE_LIBPCRE2 == 1
 #include <FileScannerPCRE2.h>
 #endif
+#if HAVE_LIBHYPERSCAN == 1
+#include <FileScannerHyperscan.h>
+#endif
 
 #include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/resource.h> // For getrlimit().
 
 #include <libext/string.hpp>
 #include <libext/filesystem.hpp>
@@ -73,6 +78,12 @@ namespace lmcppop = lmcppop_int::option;
 // The sweet spot for the number of directory tree traversal threads seems to be 4 on Linux with the new DirTree implementation.
 static constexpr size_t f_default_dirjobs = 4;
 
+// Files larger than this are read and scanned in windows of this size, to bound per-scanner-thread memory usage.
+static constexpr size_t f_default_scan_window_size = 16*1024*1024;
+
+// Default maximum number of directory file descriptors to keep open.  Also limited to a quarter of RLIMIT_NOFILE.
+static constexpr size_t f_default_dir_fd_cache_size = 256;
+
 
 /// @TODO De-literalize the copyright dates.
 static constexpr char f_program_version[] = PACKAGE_STRING "\n"
@@ -102,7 +113,7 @@ static constexpr char f_doc[] = "\nucg: the UniversalCodeGrep code search tool."
 /**
  * The "Usage:" text.
  */
-static constexpr char f_args_doc[] = "PATTERN [FILES OR DIRECTORIES]";
+static constexpr char f_args_doc[] = "PATTERN [FILES OR DIRECTORIES]\n   or: ucg [OPTION...] -f PATTERNFILE [FILES OR DIRECTORIES]";
 
 /// Keys for options without short-options.
 enum OPT
@@ -116,6 +127,7 @@ enum OPT
 	OPT_HANDLE_CASE,
 	OPT_LITERAL,
 	OPT_WORDREGEX,
+	OPT_PATTERN_FILE,
 	OPT_COLOR,
 	OPT_NOCOLOR,
 	OPT_IGNORE_DIR,
@@ -128,6 +140,9 @@ enum OPT
 	OPT_RECURSE_SUBDIRS,
 	OPT_ONLY_KNOWN_TYPES,
 	OPT_TYPE,
+	OPT_MAX_FILESIZE,
+	OPT_SEARCH_BINARY,
+	OPT_SEARCH_MINIFIED,
 	OPT_NOENV,
 	OPT_TYPE_SET,
 	OPT_TYPE_ADD,
@@ -140,9 +155,18 @@ enum OPT
 	OPT_VERSION,
 	OPT_COLUMN,
 	OPT_NOCOLUMN,
+	OPT_FILES_MATCH_MODE,
 	OPT_TEST_LOG_ALL,
 	OPT_TEST_NOENV_USER,
-	OPT_TEST_USE_MMAP,
+	OPT_MMAP,
+	OPT_PERF_DIR_FD_CACHE,
+	OPT_PERF_READ_ORDER,
+	OPT_PERF_BACKGROUND,
+	OPT_PERF_MAX_READ_RATE,
+	OPT_PERF_MATCH_LIMIT,
+	OPT_PERF_MATCH_TIME_LIMIT,
+	OPT_PERF_ENGINE,
+	OPT_TEST_SCAN_WINDOW,
 	OPT_BRACKET_NO_STANDIN
 };
 
@@ -233,10 +257,115 @@ struct Arg: public lmcppop::Arg
 		}
 		return lmcppop::ARG_ILLEGAL;
 	}
+
+	static lmcppop::ArgStatus FileSize(const lmcppop::Option& option, bool msg)
+	{
+		if (option.arg != nullptr && ParseFileSize(option.arg) > 0)
+		{
+			return lmcppop::ARG_OK;
+		}
+
+		if (msg)
+		{
+			std::cerr << "Option '" << std::string(option.name, option.namelen) << "' requires a size argument greater than 0, optionally followed by K, M, or G\n";
+		}
+		return lmcppop::ARG_ILLEGAL;
+	}
+
+	static lmcppop::ArgStatus ReadOrder(const lmcppop::Option& option, bool msg)
+	{
+		if (option.arg != nullptr && ParseReadOrder(option.arg) >= 0)
+		{
+			return lmcppop::ARG_OK;
+		}
+
+		if (msg)
+		{
+			std::cerr << "Option '" << std::string(option.name, option.namelen) << "' requires an argument of 'readdir', 'inode', or 'extent'\n";
+		}
+		return lmcppop::ARG_ILLEGAL;
+	}
+
+	static lmcppop::ArgStatus Engine(const lmcppop::Option& option, bool msg)
+	{
+		if (option.arg != nullptr && ParseEngine(option.arg) >= 0)
+		{
+			return lmcppop::ARG_OK;
+		}
+
+		if (msg)
+		{
+#if HAVE_LIBHYPERSCAN == 1
+			std::cerr << "Option '" << std::string(option.name, option.namelen) << "' requires an argument of 'pcre2' or 'hs'\n";
+#else
+			std::cerr << "Option '" << std::string(option.name, option.namelen) << "' requires an argument of 'pcre2' (this ucg wasn't built with libhs)\n";
+#endif
+		}
+		return lmcppop::ARG_ILLEGAL;
+	}
+
+	/**
+	 * Parse an --engine argument.
+	 *
+	 * @returns  1 for libhs, 0 for libpcre2 alone, or -1 if @a arg isn't valid or names an engine this ucg wasn't built with.
+	 */
+	static int ParseEngine(const char *arg) noexcept
+	{
+		if(std::strcmp(arg, "pcre2") == 0) { return 0; }
+#if HAVE_LIBHYPERSCAN == 1
+		if(std::strcmp(arg, "hs") == 0) { return 1; }
+#endif
+		return -1;
+	}
+
+	/**
+	 * Parse a --read-order argument.
+	 *
+	 * @returns  The FileReadOrder, or -1 if @a arg isn't valid.
+	 */
+	static int ParseReadOrder(const char *arg) noexcept
+	{
+		if(std::strcmp(arg, "readdir") == 0) { return FRO_READDIR; }
+		if(std::strcmp(arg, "inode") == 0) { return FRO_INODE; }
+		if(std::strcmp(arg, "extent") == 0) { return FRO_EXTENT; }
+		return -1;
+	}
+
+	/**
+	 * Parse a size in bytes, with an optional K, M, or G (power-of-two) suffix.
+	 *
+	 * @returns  The size, or 0 if @a arg isn't a valid size.
+	 */
+	static size_t ParseFileSize(const char *arg) noexcept
+	{
+		char* endptr = nullptr;
+		errno = 0;
+		unsigned long long val = strtoull(arg, &endptr, 10);
+		if(endptr == arg || errno != 0 || arg[0] == '-')
+		{
+			return 0;
+		}
+
+		switch(*endptr)
+		{
+		case 'G': case 'g': val *= 1024; [[fallthrough]];
+		case 'M': case 'm': val *= 1024; [[fallthrough]];
+		case 'K': case 'k': val *= 1024; ++endptr; break;
+		default: break;
+		}
+
+		if(*endptr != 0)
+		{
+			return 0;
+		}
+
+		return val;
+	}
 };
 
 enum OptionType { UNSPECIFIED = 0, DISABLE = 0, ENABLE = 1,
-					IGNORE = 1, SMART_CASE = 2, NO_SMART_CASE = 3 };
+					IGNORE = 1, SMART_CASE = 2, NO_SMART_CASE = 3,
+					FILES_WITH_MATCHES = 1, FILES_WITHOUT_MATCH = 2 };
 
 static constexpr char m_opt_start_str[] {"  \t"};
 static constexpr char m_help_space_str[] {"      \t"};
@@ -523,9 +652,12 @@ static const std::array f_raw_options = std::to_array<PreDescriptor>({
 		{ OPT_HANDLE_CASE, IGNORE, "i", "ignore-case", Arg::None, "Ignore case distinctions in PATTERN." },
 		{ OPT_WORDREGEX, 0, "w", "word-regexp", Arg::None, "PATTERN must match a complete word."},
 		{ OPT_LITERAL, 0, "Q", "literal", Arg::None, "Treat all characters in PATTERN as literal."},
+		{ OPT_PATTERN_FILE, 0, "f", "file", "PATTERNFILE", Arg::NonEmpty, "Search for all the patterns in PATTERNFILE, one per line, instead of PATTERN.  Each match is reported with the number of the pattern it matched."},
 	{ "Search Output:" },
 		{ OPT_COLUMN, ENABLE, "", "column", Arg::None, "Print column of first match after line number."},
 		{ OPT_COLUMN, DISABLE, "", "nocolumn", Arg::None, "Don't print column of first match (default)."},
+		{ OPT_FILES_MATCH_MODE, FILES_WITH_MATCHES, "l", "files-with-matches", Arg::None, "Only print the names of files containing matches."},
+		{ OPT_FILES_MATCH_MODE, FILES_WITHOUT_MATCH, "L", "files-without-match", Arg::None, "Only print the names of files not containing matches."},
 	{ "File presentation:" },
 		{ OPT_COLOR, ENABLE, "", "color,colour", Arg::None, "Render the output with ANSI color codes."},
 		{ OPT_COLOR, DISABLE, "", "nocolor,nocolour", Arg::None, "Render the output without ANSI color codes."},
@@ -542,6 +674,9 @@ static const std::array f_raw_options = std::to_array<PreDescriptor>({
 		{ OPT_FOLLOW, ENABLE, DISABLE, "", "[no]follow", "", Arg::None, "[Do not] follow symlinks (default: nofollow)." },
 		{ OPT_ONLY_KNOWN_TYPES, ENABLE, "k", "known-types", Arg::None, "Only search in files of recognized types (default: on)."},
 		{ OPT_TYPE, ENABLE, "", "type", "[no]TYPE", Arg::NonEmpty, "Include only [exclude all] TYPE files.  Types may also be specified as --[no]TYPE."},
+		{ OPT_MAX_FILESIZE, 0, "", "max-filesize", "SIZE", Arg::FileSize, "Skip files larger than SIZE bytes.  SIZE may be followed by K, M, or G."},
+		{ OPT_SEARCH_BINARY, ENABLE, DISABLE, "", "[no]search-binary", "", Arg::None, "[Do not] search files which appear to be binary (default: nosearch-binary)." },
+		{ OPT_SEARCH_MINIFIED, ENABLE, DISABLE, "", "[no]search-minified", "", Arg::None, "[Do not] search files which appear to be minified (default: nosearch-minified)." },
 	{ "File type specification:" },
 		{OPT_TYPE_SET, 0, "", "type-set", "TYPE:FILTER:FILTERARGS", Arg::NonEmpty, "Files FILTERed with the given FILTERARGS are treated as belonging to type TYPE.  Any existing definition of type TYPE is replaced."},
 		{OPT_TYPE_ADD, 0, "", "type-add", "TYPE:FILTER:FILTERARGS", Arg::NonEmpty, "Files FILTERed with the given FILTERARGS are treated as belonging to type TYPE.  Any existing definition of type TYPE is appended to."},
@@ -549,6 +684,14 @@ static const std::array f_raw_options = std::to_array<PreDescriptor>({
 	{ "Performance tuning:" },
 		{ OPT_PERF_DIRJOBS, 0, "", "dirjobs", "NUM_JOBS", Arg::IntegerGreater<0>, "Number of directory traversal jobs (std::thread<>s) to use." },
 		{ OPT_PERF_SCANJOBS, 0, "j", "jobs", "NUM_JOBS", Arg::IntegerGreater<0>, "Number of scanner jobs (std::thread<>s) to use."},
+		{ OPT_MMAP, ENABLE, DISABLE, "", "[no]mmap", "", Arg::None, "[Do not] mmap() large files instead of read()ing them (default: nommap)." },
+		{ OPT_PERF_READ_ORDER, 0, "", "read-order", "ORDER", Arg::ReadOrder, "Order in which to read the files in each directory: readdir, inode, or extent (default: readdir)."},
+		{ OPT_PERF_BACKGROUND, ENABLE, DISABLE, "", "[no]background", "", Arg::None, "[Do not] run at idle I/O and lowest CPU priority, and evict files from the page cache after scanning them (default: nobackground)." },
+		{ OPT_PERF_MAX_READ_RATE, 0, "", "max-read-rate", "RATE", Arg::FileSize, "Read no more than RATE bytes per second.  RATE may be followed by K, M, or G."},
+		{ OPT_PERF_MATCH_LIMIT, 0, "", "match-limit", "NUM", Arg::IntegerGreater<-1>, "Limit the regex engine to NUM backtracking steps per match attempt, matching lines which exceed it without backtracking (0 uses the engine's default)."},
+		{ OPT_PERF_MATCH_TIME_LIMIT, 0, "", "match-time-limit", "MSECS", Arg::IntegerGreater<-1>, "After MSECS milliseconds of regex matching in one file, match the rest of it without backtracking (default: 0, no limit).  Checked between match attempts, each of which is bounded by --match-limit."},
+		{ OPT_PERF_ENGINE, 0, "", "engine", "ENGINE", Arg::Engine, "Regex engine to use: pcre2, or hs to have libhs find the lines for libpcre2 to match, if ucg was built with it (default: pcre2)."},
+		{ OPT_PERF_DIR_FD_CACHE, 0, "", "dir-fd-cache", "NUM_FDS", Arg::IntegerGreater<-1>, "Maximum number of directory file descriptors to keep open for opening files relative to their directory (0 disables)."},
 	{ "Miscellaneous:" },
 		{ OPT_NOENV, 0, "", "noenv", Arg::None, "Ignore .ucgrc configuration files."},
 	{ "Informational options:" },
@@ -561,7 +704,8 @@ static const std::array f_raw_options = std::to_array<PreDescriptor>({
 	// DO NOT USE THESE.  They're going to change and go away without notice.
 		{ OPT_TEST_LOG_ALL, 0, "", "test-log-all", "", Arg::None, "Enable all logging output.", PreDescriptor::hidden_tag() },
 		{ OPT_TEST_NOENV_USER, 0, "", "test-noenv-user", "", Arg::None, "Don't search for or use $HOME/.ucgrc.", PreDescriptor::hidden_tag() },
-		{ OPT_TEST_USE_MMAP, 0, "", "test-use-mmap", "", Arg::None, "Use mmap() to access files being searched.", PreDescriptor::hidden_tag() },
+		{ OPT_MMAP, ENABLE, "", "test-use-mmap", "", Arg::None, "Use mmap() to access files being searched.", PreDescriptor::hidden_tag() },
+		{ OPT_TEST_SCAN_WINDOW, 0, "", "test-scan-window", "BYTES", Arg::IntegerGreater<0>, "Scan files larger than BYTES in windows of BYTES bytes.", PreDescriptor::hidden_tag() },
 	// Epilogue Text.
 		{ "\n" "Mandatory or optional arguments to long options are also mandatory or optional for any corresponding short options." "\n", PreDescriptor::arbtext_tag() },
 		// Again, this folderol is to keep the f_doc[] string in the same format as used by argp.
@@ -713,7 +857,7 @@ void ArgParse::Parse(int argc, char **argv)
 		exit(0);
 		return;
 	}
-	else if(parse.nonOptionsCount() == 0)
+	else if(parse.nonOptionsCount() == 0 && !options[OPT_PATTERN_FILE])
 	{
 		// Need at least the PATTERN.
 		/// @todo print short usage
@@ -722,14 +866,30 @@ void ArgParse::Parse(int argc, char **argv)
 		exit(STATUS_EX_USAGE);
 	}
 
-	// Grab the pattern.
-	if(parse.nonOptionsCount() > 0)
+	// Grab the pattern(s).
+	int first_path_index = 0;
+	if(options[OPT_PATTERN_FILE])
+	{
+		// The patterns come from the pattern file(s), so all the non-options are paths.
+		size_t line_no = 0;
+		for(lmcppop::Option* opt = options[OPT_PATTERN_FILE]; opt; opt = opt->next())
+		{
+			ReadPatternFile(opt->arg, &line_no);
+		}
+		if(m_patterns.empty())
+		{
+			std::cerr << "ucg: No patterns in pattern file.\n";
+			exit(STATUS_EX_USAGE);
+		}
+	}
+	else if(parse.nonOptionsCount() > 0)
 	{
-		m_pattern = parse.nonOption(0);
+		m_patterns.push_back(parse.nonOption(0));
+		first_path_index = 1;
 	}
 
 	// Grab any file/dir paths specified on command line.
-	for (int i = 1; i < parse.nonOptionsCount(); ++i)
+	for (int i = first_path_index; i < parse.nonOptionsCount(); ++i)
 	{
     	m_paths.push_back(parse.nonOption(i));
 	}
@@ -740,8 +900,8 @@ void ArgParse::Parse(int argc, char **argv)
 		INFO::Enable(true);
 		DEBUG::Enable(true);
 	}
-	// Handle --test-use-mmap.
-	m_use_mmap = (options[OPT_TEST_USE_MMAP].last()->type() == ENABLE);
+	// Handle --[no]mmap and its older alias --test-use-mmap.
+	m_use_mmap = (options[OPT_MMAP].last()->type() == ENABLE);
 
 	// Work out the interaction between ignore-case and smart-case.
 	for(lmcppop::Option* opt = options[OPT_HANDLE_CASE]; opt; opt = opt->next())
@@ -764,6 +924,11 @@ void ArgParse::Parse(int argc, char **argv)
 	m_word_regexp = options[OPT_WORDREGEX];
 	m_pattern_is_literal = options[OPT_LITERAL];
 	m_column = (options[OPT_COLUMN].last()->type() == ENABLE);
+	if(options[OPT_FILES_MATCH_MODE]) // The last of -l or -L wins.
+	{
+		m_files_with_matches = (options[OPT_FILES_MATCH_MODE].last()->type() == FILES_WITH_MATCHES);
+		m_files_without_match = (options[OPT_FILES_MATCH_MODE].last()->type() == FILES_WITHOUT_MATCH);
+	}
 	if(options[OPT_COLOR]) // If not specified on command line, defaults to both == false.
 	{
 		m_color = (options[OPT_COLOR].last()->type() == ENABLE);
@@ -775,6 +940,12 @@ void ArgParse::Parse(int argc, char **argv)
 		m_recurse = (options[OPT_RECURSE_SUBDIRS].last()->type() == ENABLE);
 	}
 	m_follow_symlinks = (options[OPT_FOLLOW].last()->type() == ENABLE);
+	if(lmcppop::Option* opt = options[OPT_MAX_FILESIZE])
+	{
+		m_max_filesize = Arg::ParseFileSize(opt->last()->arg);
+	}
+	m_search_binary = (options[OPT_SEARCH_BINARY].last()->type() == ENABLE);
+	m_search_minified = (options[OPT_SEARCH_MINIFIED].last()->type() == ENABLE);
 
 	for(lmcppop::Option* opt = options[OPT_IGNORE_DIR]; opt; opt=opt->next())
 	{
@@ -825,6 +996,35 @@ void ArgParse::Parse(int argc, char **argv)
 	{
 		m_jobs = std::stoi(opt->arg);
 	}
+	m_background = (options[OPT_PERF_BACKGROUND].last()->type() == ENABLE);
+	if(lmcppop::Option* opt = options[OPT_PERF_MAX_READ_RATE])
+	{
+		m_max_read_rate = Arg::ParseFileSize(opt->last()->arg);
+	}
+	if(lmcppop::Option* opt = options[OPT_PERF_MATCH_LIMIT])
+	{
+		m_match_limit = std::stoull(opt->last()->arg);
+	}
+	if(lmcppop::Option* opt = options[OPT_PERF_MATCH_TIME_LIMIT])
+	{
+		m_match_time_limit = std::stoull(opt->last()->arg);
+	}
+	if(lmcppop::Option* opt = options[OPT_PERF_ENGINE])
+	{
+		m_use_libhs = (Arg::ParseEngine(opt->last()->arg) == 1);
+	}
+	if(lmcppop::Option* opt = options[OPT_PERF_READ_ORDER])
+	{
+		m_read_order = static_cast<FileReadOrder>(Arg::ParseReadOrder(opt->last()->arg));
+	}
+	if(lmcppop::Option* opt = options[OPT_PERF_DIR_FD_CACHE])
+	{
+		m_dir_fd_cache_size = std::stoll(opt->arg);
+	}
+	if(lmcppop::Option* opt = options[OPT_TEST_SCAN_WINDOW])
+	{
+		m_scan_window_size = std::stoull(opt->arg);
+	}
 
 	//// Now set up some defaults which we can only determine after all arg parsing is complete.
 
@@ -848,6 +1048,24 @@ void ArgParse::Parse(int argc, char **argv)
 		m_dirjobs = f_default_dirjobs;
 	}
 
+	// Size of the directory descriptor cache.
+	if(m_dir_fd_cache_size < 0)
+	{
+		// Wasn't specified on command line.  Use the default, but leave plenty of descriptors for everything else.
+		m_dir_fd_cache_size = f_default_dir_fd_cache_size;
+		struct rlimit rl;
+		if(getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY)
+		{
+			m_dir_fd_cache_size = std::min(m_dir_fd_cache_size, static_cast<long long>(rl.rlim_cur/4));
+		}
+	}
+
+	// Size of the windows used to scan large files.
+	if(m_scan_window_size == 0)
+	{
+		m_scan_window_size = f_default_scan_window_size;
+	}
+
 	// Search files/directories.
 	if(m_paths.empty())
 	{
@@ -865,8 +1083,11 @@ void ArgParse::Parse(int argc, char **argv)
 		/// @todo This really should be the environment's default locale (loc("")).  Cygwin doesn't support this
 		/// at the moment (loc("") throws), and the rest of ucg isn't localized anyway, so this should work for now.
 		std::locale loc;
-		// Look for the first uppercase char in PATTERN.
-		if(std::find_if(m_pattern.cbegin(), m_pattern.cend(), [&loc](decltype(m_pattern)::value_type c){ return std::isupper(c, loc); }) == m_pattern.cend())
+		// Look for the first uppercase char in PATTERN, or in any of the patterns from the pattern files.
+		auto has_upper = [&loc](const std::string &pattern){
+			return std::find_if(pattern.cbegin(), pattern.cend(), [&loc](char c){ return std::isupper(c, loc); }) != pattern.cend();
+		};
+		if(std::none_of(m_patterns.cbegin(), m_patterns.cend(), has_upper))
 		{
 			// Didn't find one, so match without regard to case.
 			m_ignore_case = true;
@@ -995,6 +1216,53 @@ void ArgParse::PrintVersionText(FILE* stream)
 		std::fprintf(stream, " Newline style: %s\n", s.c_str());
 #endif
 	}
+
+	//
+	// libhs info
+	//
+	{
+		std::fprintf(stream, "\nlibhs info:\n");
+#if HAVE_LIBHYPERSCAN == 0
+		std::fprintf(stream, " Not linked against libhs.\n");
+#else
+		std::fprintf(stream, " Version: %s\n", FileScannerHyperscan::GetHyperscanVersion().c_str());
+#endif
+	}
+}
+
+void ArgParse::ReadPatternFile(const std::string &filename, size_t *line_no)
+{
+	try
+	{
+		File pattern_file(filename, FAM_RDONLY, FCF_NOATIME | FCF_NOCTTY);
+
+		const char *pos = pattern_file.data();
+		const char *end = pos + pattern_file.size();
+		while(pos < end)
+		{
+			const char *eol = std::find(pos, end, '\n');
+			std::string pattern(pos, eol);
+			++*line_no;
+			if(!pattern.empty() && pattern.back() == '\r')
+			{
+				// DOS line ending.
+				pattern.pop_back();
+			}
+			if(!pattern.empty())
+			{
+				m_patterns.push_back(std::move(pattern));
+				m_pattern_numbers.push_back(*line_no);
+			}
+			pos = eol + 1;
+		}
+	}
+	catch(const std::system_error &e)
+	{
+		std::cerr << "ucg: Couldn't read pattern file '" << filename << "': " << e.code().message() << "\n";
+		exit(STATUS_EX_USAGE);
+	}
+
+	LOG(INFO) << "Read patterns from '" << filename << "', " << m_patterns.size() << " total patterns.";
 }
 
 void ArgParse::PrintHelpTypes() const
@@ -29,6 +29,8 @@
 #include <set>
 #include <cstdio>
 
+#include "libext/FileID.h" // For FileReadOrder.
+
 
 class TypeManager;
 class File;
@@ -93,6 +95,16 @@ private:
 
 	void HandleTYPELogic(std::vector<char *> *v);
 
+	/**
+	 * Read the patterns in the --file PATTERNFILE @a filename, one per line, and append them to m_patterns, and
+	 * their line numbers to m_pattern_numbers.  Blank lines are skipped, but still counted.
+	 * Exits with an error message if the file can't be read.
+	 *
+	 * @param filename
+	 * @param line_no  In: the number of lines in the PATTERNFILEs read so far.  Out: plus those in this one.
+	 */
+	void ReadPatternFile(const std::string &filename, size_t *line_no);
+
 	/// If true, ArgParse won't look for or use $HOME/.ucgrc.
 	/// Used for testing.
 	bool m_test_noenv_user { false };
@@ -110,8 +122,12 @@ public:
 	/// get ambitious, it might make sense to factor these into a separate struct that gets passed around instead.
 	///@{
 
-	/// The regex to be matched.
-	std::string m_pattern;
+	/// The regexes to be matched.  The one PATTERN given on the command line, or those read from the --file PATTERNFILEs.
+	std::vector<std::string> m_patterns;
+
+	/// If the patterns were read from --file PATTERNFILEs, the number each match reports for the one it matched: the
+	/// line it's on, with the lines of each PATTERNFILE counting on from those of the ones before it.  Otherwise empty.
+	std::vector<size_t> m_pattern_numbers;
 
 	/// true if the case of PATTERN should be ignored.
 	bool m_ignore_case { false };
@@ -125,6 +141,12 @@ public:
 	/// true if we should print the column of the first match after the line number.
 	bool m_column { false };
 
+	/// Only print the names of files which have matches.
+	bool m_files_with_matches { false };
+
+	/// Only print the names of files which have no matches.
+	bool m_files_without_match { false };
+
 	/// The file and directory paths given on the command line.
 	std::vector<std::string> m_paths;
 
@@ -147,8 +169,42 @@ public:
 
 	bool m_follow_symlinks { false };
 
+	/// Files larger than this many bytes are skipped.  0 means no limit.
+	size_t m_max_filesize { 0 };
+
+	/// Whether to search files which appear to be binary.
+	bool m_search_binary { false };
+
+	/// Whether to search files which appear to be minified.
+	bool m_search_minified { false };
+
+	/// true if large files should be mmap()ed instead of read().
 	bool m_use_mmap { false };
 
+	/// Files larger than this many bytes are read() and scanned in windows of this size.
+	size_t m_scan_window_size { 0 };
+
+	/// Maximum number of directory file descriptors to keep cached.  -1 == not specified on command line.
+	long long m_dir_fd_cache_size { -1 };
+
+	/// Order in which to read the files in each directory.
+	FileReadOrder m_read_order { FRO_READDIR };
+
+	/// true if --engine=hs: libhs finds the lines which might match, and libpcre2 only matches those.
+	bool m_use_libhs { false };
+
+	/// Run at low CPU and I/O priority, and don't leave scanned files in the page cache.
+	bool m_background { false };
+
+	/// Maximum bytes per second to read.  0 == no limit.
+	size_t m_max_read_rate { 0 };
+
+	/// Limit on libpcre2's backtracking per match attempt.  0 == libpcre2's default.
+	size_t m_match_limit { 0 };
+
+	/// Milliseconds libpcre2 may spend matching in one file before the rest of it is matched without backtracking.  0 == no limit.
+	size_t m_match_time_limit { 0 };
+
 	///@}
 };
 
@@ -23,6 +23,8 @@
 
 #include <iostream>
 #include <system_error>
+#include <cerrno>
+#include <cstring>
 
 #include <fcntl.h>
 #include <libext/Logger.h>
@@ -31,12 +33,20 @@
 #include <sys/mman.h>
 
 
-// @note This gets the unused mmap code below to build on FreeBSD (TrueOS).
+// @note This gets the mmap code below to build on FreeBSD (TrueOS).
 #if !defined(MAP_NORESERVE)
 #define MAP_NORESERVE 0
 #endif
+#if !defined(MAP_POPULATE)
+#define MAP_POPULATE 0
+#endif
+// OSX and some older BSDs only have the non-POSIX name.
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
 
-File::File(std::shared_ptr<FileID> file_id, std::shared_ptr<ResizableArray<char>> storage) : m_fileid(std::move(file_id)), m_storage(storage)
+File::File(std::shared_ptr<FileID> file_id, std::shared_ptr<ResizableArray<char>> storage, bool use_mmap)
+	: m_fileid(std::move(file_id)), m_storage(storage), m_use_mmap(use_mmap)
 {
 	int file_descriptor { -1 };
 
@@ -112,60 +122,233 @@ File::~File()
 	FreeFileData(m_file_data, m_fileid->GetFileSize());
 }
 
-const char* File::GetFileData(int file_descriptor, size_t file_size, size_t preferred_block_size)
+void File::Readahead(FileID &file_id, size_t max_bytes) noexcept
 {
-	const char *file_data = static_cast<const char *>(MAP_FAILED);
+	try
+	{
+		int file_descriptor = file_id.GetFileDescriptor();
+
+		// No need to stat() the file to clamp this to its size, the kernel won't read past EOF.
+		size_t len = max_bytes;
 
-	if(false) /// @todo This is very broken right now.  (m_use_mmap)
+		// Both of these start the I/O and return without waiting for it to complete.
+#if defined(HAVE_READAHEAD)
+		(void)readahead(file_descriptor, 0, len);
+#elif defined(HAVE_POSIX_FADVISE)
+		(void)posix_fadvise(file_descriptor, 0, len, POSIX_FADV_WILLNEED);
+#else
+		(void)file_descriptor;
+		(void)len;
+#endif
+	}
+	catch(...)
 	{
-		file_data = static_cast<const char *>(mmap(NULL, file_size, PROT_READ, MAP_PRIVATE /*| MAP_NORESERVE | MAP_POPULATE*/, file_descriptor, 0));
+		// Ignore, File() will hit and report the same error.
+	}
+}
 
-		if(file_data == MAP_FAILED)
+const char* File::GetFileData(int file_descriptor, size_t file_size, size_t preferred_block_size)
+{
+	const char *file_data = nullptr;
+
+	if(IsMmapCandidate(file_size, m_use_mmap))
+	{
+		file_data = MapFileData(file_descriptor, file_size);
+		if(file_data != nullptr)
 		{
-			// Mapping failed.
-			close(file_descriptor);
 			return file_data;
 		}
 
-		// Hint that we'll be sequentially reading the mmapped file soon.
-		posix_madvise(const_cast<char*>(file_data), file_size, POSIX_MADV_SEQUENTIAL | POSIX_MADV_WILLNEED);
+		// Mapping failed.  Fall back to read()ing the file.
+		LOG(INFO) << "mmap() of file '" << m_fileid->GetPath() << "' failed, falling back to read(): " << LOG_STRERROR();
+		errno = 0;
 	}
-	else
-	{
-		// Not using mmap().
+
+	// Not using mmap().
 
 #ifdef HAVE_POSIX_FADVISE // OSX doesn't have it.
-		// Notify the filesystem of our intentions to:
-		// - Access the file sequentially.  This will cause Linux to double the file's readahead window.
-		// - That we'll need the contents in the near future.  Per the Linux manpage, this will cause it to start
-		//   a non-blocking read of the file.
-		// Explicitly ignoring the return value for Coverity's sake.  If the advice is ignored, we should still be functional.
-		(void)posix_fadvise(file_descriptor, 0, 0, POSIX_FADV_SEQUENTIAL /*| POSIX_FADV_WILLNEED*/);
+	// Notify the filesystem of our intentions to:
+	// - Access the file sequentially.  This will cause Linux to double the file's readahead window.
+	// - That we'll need the contents in the near future.  Per the Linux manpage, this will cause it to start
+	//   a non-blocking read of the file.
+	// Explicitly ignoring the return value for Coverity's sake.  If the advice is ignored, we should still be functional.
+	(void)posix_fadvise(file_descriptor, 0, 0, POSIX_FADV_SEQUENTIAL /*| POSIX_FADV_WILLNEED*/);
 #endif
 
-		file_data = m_storage->realloc(file_size, preferred_block_size);
+	char *buffer = m_storage->realloc(file_size, preferred_block_size);
 
-		// Read in the whole file.
-		ssize_t retval = 0;
-		while((retval = read(file_descriptor, const_cast<char*>(file_data), file_size)) > 0);
-		if(retval < 0)
-		{
-			// read error.
-			ERROR() << "read() error on file '" << "<<TODO>>" << "', descriptor " << file_descriptor << ": " << LOG_STRERROR();
-			errno = 0;
-		}
+	// Read in the whole file.
+	ssize_t total_read = Read(file_descriptor, buffer, file_size);
+	if(total_read < 0)
+	{
+		// read error.
+		ERROR() << "read() error on file '" << m_fileid->GetPath() << "', descriptor " << file_descriptor << ": " << LOG_STRERROR();
+		errno = 0;
+		total_read = 0;
+	}
+	if(static_cast<size_t>(total_read) < file_size)
+	{
+		// Either an error or EOF before we got file_size bytes, i.e. the file was truncated since we stat()ed it.
+		// Zero the rest so we don't scan stale data left over from the last file in this buffer.
+		std::memset(buffer + total_read, 0, file_size - total_read);
 	}
 
 	// We don't need the file descriptor anymore.
 	///@todo close(file_descriptor);
 
-	return file_data;
+	return buffer;
+}
+
+void File::DropFromPageCache(FileID &file_id) noexcept
+{
+#ifdef HAVE_POSIX_FADVISE
+	try
+	{
+		// The file will already be open if we read anything from it.
+		(void)posix_fadvise(file_id.GetFileDescriptor(), 0, 0, POSIX_FADV_DONTNEED);
+	}
+	catch(...)
+	{
+		// Ignore, this is only advice.
+	}
+#else
+	(void)file_id;
+#endif
+}
+
+ssize_t File::ReadIfSmall(FileID &file_id, char *buffer, size_t max_size)
+{
+	int file_descriptor = file_id.GetFileDescriptor();
+
+	// Try to read one more byte than max_size.  If we get it, the file isn't small.
+	// Note that we don't need to stat() the file to find out.
+	ssize_t bytes_read = Read(file_descriptor, buffer, max_size+1);
+	if(bytes_read < 0)
+	{
+		throw FileException("read() error on file '" + file_id.GetPath() + "'", errno);
+	}
+
+	if(static_cast<size_t>(bytes_read) > max_size)
+	{
+		// Too big.  Rewind so the file can be read normally.
+		if(lseek(file_descriptor, 0, SEEK_SET) != 0)
+		{
+			throw FileException("lseek() error on file '" + file_id.GetPath() + "'", errno);
+		}
+		return -1;
+	}
+
+	// Zero-out the trailing vector's worth of padding, like ResizableArray::realloc() does.
+	std::memset(buffer + bytes_read, 0, 1024/8);
+
+	return bytes_read;
+}
+
+size_t File::ReadHead(FileID &file_id, char *buffer, size_t len)
+{
+	int file_descriptor = file_id.GetFileDescriptor();
+	size_t total_read = 0;
+
+	while(total_read < len)
+	{
+		ssize_t retval = pread(file_descriptor, buffer + total_read, len - total_read, total_read);
+		if(retval > 0)
+		{
+			total_read += retval;
+		}
+		else if(retval == 0)
+		{
+			// EOF.
+			break;
+		}
+		else if(errno != EINTR)
+		{
+			throw FileException("pread() error on file '" + file_id.GetPath() + "'", errno);
+		}
+	}
+
+	return total_read;
+}
+
+ssize_t File::Read(int file_descriptor, char *buffer, size_t len) noexcept
+{
+	size_t total_read = 0;
+
+	while(total_read < len)
+	{
+		ssize_t retval = read(file_descriptor, buffer + total_read, len - total_read);
+		if(retval > 0)
+		{
+			total_read += retval;
+		}
+		else if(retval == 0)
+		{
+			// EOF.
+			break;
+		}
+		else if(errno != EINTR)
+		{
+			return -1;
+		}
+	}
+
+	return total_read;
+}
+
+const char* File::MapFileData(int file_descriptor, size_t file_size) noexcept
+{
+	// The scanners may read up to a vector's worth of bytes past the end of the file data.  If the file size is
+	// a multiple of the page size, that would fault, so we first reserve an anonymous, zero-filled region with
+	// enough room for that padding, and then map the file over the front of it.
+	constexpr size_t padding = 1024/8;
+	static const size_t page_size = sysconf(_SC_PAGESIZE);
+
+	// Make sure the file hasn't changed size since we stat()ed it.  Touching mapped pages past EOF raises SIGBUS,
+	// so if it has, let the read() path deal with it.
+	struct stat st;
+	if(fstat(file_descriptor, &st) != 0 || static_cast<size_t>(st.st_size) != file_size)
+	{
+		return nullptr;
+	}
+
+	size_t mapped_size = ((file_size + padding + page_size - 1) / page_size) * page_size;
+
+	void *region = mmap(NULL, mapped_size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if(region == MAP_FAILED)
+	{
+		return nullptr;
+	}
+
+	// MAP_POPULATE prefaults the whole file in, with the kernel doing readahead, so the scan doesn't take a page fault
+	// every 4K.
+	void *file_data = mmap(region, file_size, PROT_READ, MAP_PRIVATE | MAP_FIXED | MAP_POPULATE, file_descriptor, 0);
+	if(file_data == MAP_FAILED)
+	{
+		munmap(region, mapped_size);
+		return nullptr;
+	}
+
+	// Hint that we'll be sequentially reading the mmapped file soon.  These are advice values, not flags, so
+	// they can't be OR'ed together.
+	(void)posix_madvise(file_data, file_size, POSIX_MADV_SEQUENTIAL);
+	if(MAP_POPULATE == 0)
+	{
+		(void)posix_madvise(file_data, file_size, POSIX_MADV_WILLNEED);
+	}
+
+	m_mapped_size = mapped_size;
+
+	return static_cast<const char *>(file_data);
 }
 
 void File::FreeFileData(const char* file_data, size_t file_size) noexcept
 {
-	if(m_use_mmap)
+	(void)file_size;
+
+	if(m_mapped_size != 0)
 	{
-		munmap(const_cast<char*>(file_data), file_size);
+		// This unmaps both the file and the trailing anonymous padding.
+		munmap(const_cast<char*>(file_data), m_mapped_size);
+		m_mapped_size = 0;
 	}
 }
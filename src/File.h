@@ -37,7 +37,15 @@
 class File
 {
 public:
-	explicit File(std::shared_ptr<FileID> file_id, std::shared_ptr<ResizableArray<char>> storage = std::make_shared<ResizableArray<char>>());
+	/**
+	 * Constructor.  Opens and reads in or mmap()s the file described by @a file_id.
+	 *
+	 * @param file_id   The FileID of the file to access.
+	 * @param storage   The ResizableArray to read() the file data into, if it isn't mmap()ed.
+	 * @param use_mmap  If true, files of at least #m_mmap_threshold bytes will be mmap()ed instead of read().
+	 */
+	explicit File(std::shared_ptr<FileID> file_id, std::shared_ptr<ResizableArray<char>> storage = std::make_shared<ResizableArray<char>>(),
+			bool use_mmap = false);
 	File(const std::string &filename, FileAccessMode fam, FileCreationFlag fcf,
 			std::shared_ptr<ResizableArray<char>> storage = std::make_shared<ResizableArray<char>>());
 	~File();
@@ -46,6 +54,63 @@ public:
 
 	[[nodiscard]] const char * data() const noexcept { return m_file_data; };
 
+	/**
+	 * Returns true if a File constructed with the given @a use_mmap would try to mmap() a file of @a file_size bytes.
+	 */
+	[[nodiscard]] static constexpr bool IsMmapCandidate(size_t file_size, bool use_mmap) noexcept
+	{
+		return use_mmap && file_size >= m_mmap_threshold;
+	};
+
+	/**
+	 * read() up to @a len bytes from @a file_descriptor into @a buffer, retrying on EINTR and short reads.
+	 *
+	 * @return  The number of bytes read, which will be less than @a len only at EOF, or -1 on error with errno set.
+	 */
+	static ssize_t Read(int file_descriptor, char *buffer, size_t len) noexcept;
+
+	/**
+	 * Small-file fast path.  Reads the file described by @a file_id into @a buffer if it's no larger than @a max_size
+	 * bytes, without stat()ing it or going through the fadvise()/aligned buffer setup a File would do.
+	 *
+	 * @param buffer    Must have room for @a max_size + 1 bytes plus a trailing vector's worth of padding, which will be zeroed.
+	 * @param max_size  Largest file size to read.
+	 * @return  The size of the file if it was read in, or -1 if it's larger than @a max_size.  In the latter case, the
+	 *          file descriptor is rewound so that a File can still be constructed from @a file_id.
+	 * @throws FileException on open or read errors.
+	 */
+	static ssize_t ReadIfSmall(FileID &file_id, char *buffer, size_t max_size);
+
+	/**
+	 * pread() the first @a len bytes of the file described by @a file_id into @a buffer, without
+	 * changing the file offset.
+	 *
+	 * @return  The number of bytes read, which will be less than @a len only if the file is shorter than that.
+	 * @throws FileException on open or read errors.
+	 */
+	static size_t ReadHead(FileID &file_id, char *buffer, size_t len);
+
+	/**
+	 * Start an asynchronous read of the first @a max_bytes of the file described by @a file_id into the page cache,
+	 * so that a File constructed from it later doesn't have to wait on the disk.  Uses readahead() where available,
+	 * and posix_fadvise(POSIX_FADV_WILLNEED) otherwise.  Does nothing if neither is available.
+	 *
+	 * Errors are ignored; they'll be reported when the File is actually constructed.
+	 *
+	 * @param file_id    The file to start reading in.
+	 * @param max_bytes  Maximum number of bytes to read ahead.
+	 */
+	static void Readahead(FileID &file_id, size_t max_bytes) noexcept;
+
+	/**
+	 * Tell the kernel we won't be needing the file described by @a file_id again, so that its pages can be evicted
+	 * from the page cache instead of pushing out some other process's working set.  Uses
+	 * posix_fadvise(POSIX_FADV_DONTNEED) where available, does nothing otherwise.
+	 *
+	 * Any mmap() of the file must already have been unmapped, or its pages won't be evicted.  Errors are ignored.
+	 */
+	static void DropFromPageCache(FileID &file_id) noexcept;
+
 	/**
 	 * Returns the name of this File as passed to the constructor.
 	 * @return  The name of this File as passed to the constructor.
@@ -56,7 +121,8 @@ private:
 
 	/**
 	 * Return a pointer to a buffer containing the contents of the file described by #file_descriptor.
-	 * May be mmap()'ed or read() into a newed buffer depending on m_use_mmap.
+	 * May be mmap()'ed or read() into m_storage depending on m_use_mmap and the file's size.  If the mmap() attempt
+	 * fails for any reason, falls back to read().
 	 *
 	 * @note file_descriptor will be closed after this function returns.
 	 *
@@ -66,6 +132,14 @@ private:
 	 */
 	const char* GetFileData(int file_descriptor, size_t file_size, size_t preferred_block_size);
 
+	/**
+	 * Try to mmap() the file described by #file_descriptor.  The mapping is followed by at least a vector's worth of
+	 * zeroed bytes, the same guarantee ResizableArray::realloc() provides for the read() case.
+	 *
+	 * @return  Pointer to the mapped file data, or nullptr on failure.
+	 */
+	const char* MapFileData(int file_descriptor, size_t file_size) noexcept;
+
 	/**
 	 * Frees the resources allocated by GetFileData().
 	 *
@@ -81,8 +155,15 @@ private:
 
 	const char *m_file_data { nullptr };
 
+	/// Files at least this large will be mmap()ed if m_use_mmap is true.  Smaller files are cheaper to read().
+	static constexpr size_t m_mmap_threshold { 1024*1024 };
+
+	/// true if we should try to mmap() files of at least m_mmap_threshold bytes.
 	bool m_use_mmap { false };
 
+	/// Size of the mapping at m_file_data if it was mmap()ed, 0 if it was read() into m_storage.
+	size_t m_mapped_size { 0 };
+
 };
 
 #endif /* FILE_H_ */
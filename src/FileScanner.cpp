@@ -26,6 +26,7 @@
 #include "FileScannerCpp11.h"
 #include "FileScannerPCRE.h"
 #include "FileScannerPCRE2.h"
+#include "FileScannerHyperscan.h"
 #include "File.h"
 #include "Match.h"
 #include "MatchList.h"
@@ -35,11 +36,17 @@
 #include <future/string.hpp>
 #include <libext/string.hpp>
 #include <libext/Logger.h>
+#include <libext/memory.hpp>
 #include <thread>
 #include <mutex>
+#include <deque>
 #include <cstring> // For memchr().
+#include <algorithm>
+#include <iterator>
 #include <cstddef> // For ptrdiff_t
 #include <cctype>
+#include <array>
+#include <fcntl.h> // For posix_fadvise().
 #ifndef HAVE_SCHED_SETAFFINITY
 #else
 	#include <sched.h>
@@ -50,6 +57,33 @@
 
 static std::mutex f_assign_affinity_mutex;
 
+/// Number of files each scanner thread keeps in its read-ahead window.
+/// Kept small so that one thread doesn't hoard work the other scanner threads could be doing.
+static constexpr size_t f_readahead_depth = 4;
+
+/// Files no larger than this are read by the small-file fast path.
+static constexpr size_t f_small_file_max_size = 8*1024;
+
+/// Size of the per-thread slab the small-file fast path reads batches of small files into.
+static constexpr size_t f_small_file_slab_size = 256*1024;
+
+/// Each small file in the slab gets at least this much space: the file, one extra byte to detect a too-big file,
+/// and a vector's worth of zeroed padding.
+static constexpr size_t f_small_file_slot_size = f_small_file_max_size + 1 + 1024/8;
+
+/// Buffers at least twice this size are split into segments of about this size for ScanBuffer() to scan in parallel.
+static constexpr size_t f_segment_size = 2*1024*1024;
+
+/// Size of the first block of each file which is checked by the pre-admission sniff test.
+static constexpr size_t f_sniff_block_size = 64*1024;
+
+/// Files with a line at least this long in their first block are considered minified.
+static constexpr size_t f_minified_line_length = 16*1024;
+
+/// Maximum number of bytes of each file to read ahead.  The kernel's own sequential readahead takes care of
+/// the rest of large files once we start reading them.
+static constexpr size_t f_readahead_max_bytes = 2*1024*1024;
+
 /// Resolver function for determining the best version of CountLinesSinceLastMatch to call.
 /// Does its work at static init time, so incurs no call-time overhead.
 extern "C"	void * resolve_CountLinesSinceLastMatch(void);
@@ -59,34 +93,59 @@ size_t (*FileScanner::CountLinesSinceLastMatch)(const char * __restrict__ prev_l
 		const char * __restrict__ start_of_current_match) noexcept
 		= reinterpret_cast<decltype(FileScanner::CountLinesSinceLastMatch)>(::resolve_CountLinesSinceLastMatch());
 
+/// Resolver function for determining the best version of SniffBlock to call.
+extern "C"	void * resolve_SniffBlock(void);
+
+/// Definition of the multiversioned SniffBlock function.
+size_t (*FileScanner::SniffBlock)(const char * __restrict__ cbegin, const char * __restrict__ cend) noexcept
+		= reinterpret_cast<decltype(FileScanner::SniffBlock)>(::resolve_SniffBlock());
+
 
 std::unique_ptr<FileScanner> FileScanner::Create(sync_queue<std::shared_ptr<FileID>> &in_queue,
 			sync_queue<MatchList> &output_queue,
-			std::string regex,
-			bool ignore_case,
-			bool word_regexp,
-			bool pattern_is_literal,
-			RegexEngine engine)
+			const ScannerOptions &options)
 {
 	std::unique_ptr<FileScanner> retval;
 
-	switch(engine)
+	bool pattern_is_literal = options.pattern_is_literal;
+	std::vector<std::string> pattern_regexes;
+	std::string regex = CombinePatterns(options.patterns, &pattern_is_literal, &pattern_regexes);
+
+	switch(options.engine)
 	{
 	case RegexEngine::CXX11:
-		retval.reset(new FileScannerCpp11(in_queue, output_queue, regex, ignore_case, word_regexp, pattern_is_literal));
+		retval.reset(new FileScannerCpp11(in_queue, output_queue, regex, options.ignore_case, options.word_regexp, pattern_is_literal));
 		break;
 	case RegexEngine::PCRE:
-		retval.reset(new FileScannerPCRE(in_queue, output_queue, regex, ignore_case, word_regexp, pattern_is_literal));
+		retval.reset(new FileScannerPCRE(in_queue, output_queue, regex, options.ignore_case, options.word_regexp, pattern_is_literal));
 		break;
 	case RegexEngine::PCRE2:
-		retval.reset(new FileScannerPCRE2(in_queue, output_queue, regex, ignore_case, word_regexp, pattern_is_literal));
+		retval.reset(new FileScannerPCRE2(in_queue, output_queue, regex, options.ignore_case, options.word_regexp, pattern_is_literal));
+		break;
+	case RegexEngine::HYPERSCAN:
+		// Falls back to plain libpcre2 matching by itself if libhs can't compile the regex.
+		retval.reset(new FileScannerHyperscan(in_queue, output_queue, regex, options.ignore_case, options.word_regexp, pattern_is_literal));
 		break;
 	default:
 		// Should never get here.  Throw.
-		throw FileScannerException(std::string("invalid RegexEngine specified: ") + std::to_string(static_cast<int>(engine)));
+		throw FileScannerException(std::string("invalid RegexEngine specified: ") + std::to_string(static_cast<int>(options.engine)));
 		break;
 	}
 
+	retval->m_use_mmap = options.use_mmap;
+	retval->m_scan_window_size = options.scan_window_size;
+	retval->m_max_filesize = options.max_filesize;
+	retval->m_search_binary = options.search_binary;
+	retval->m_search_minified = options.search_minified;
+	retval->m_first_match_only = options.files_with_matches || options.files_without_match;
+	retval->m_files_without_match = options.files_without_match;
+	retval->m_drop_from_page_cache = options.drop_from_page_cache;
+	retval->m_max_read_rate = options.max_read_rate;
+	retval->m_match_limit = options.match_limit;
+	retval->m_match_time_limit = options.match_time_limit;
+	retval->m_pattern_numbers = options.pattern_numbers;
+	retval->m_pattern_regexes = std::move(pattern_regexes);
+
 	return retval;
 }
 
@@ -100,10 +159,13 @@ FileScanner::FileScanner(sync_queue<std::shared_ptr<FileID>> &in_queue,
 				m_next_core(0), m_use_mmap(false), m_manually_assign_cores(false)
 {
 	LiteralMatch = resolve_LiteralMatch(this);
+	find_first_of = resolve_find_first_of();
+	find = resolve_find();
 }
 
 FileScanner::~FileScanner()
 {
+	LOG(INFO) << "Pre-admission stats:" << m_admission_stats;
 }
 
 void FileScanner::Run(int thread_index)
@@ -120,62 +182,149 @@ void FileScanner::Run(int thread_index)
 	// Create a reusable, resizable buffer for the File() reads.
 	auto file_data_storage = std::make_shared<ResizableArray<char>>();
 
+	// And one for batches of small files.
+	auto small_file_slab = std::make_unique<ResizableArray<char>>();
+
 	using namespace std::chrono;
 	steady_clock::duration accum_elapsed_time {0};
 	long long total_bytes_read {0};
 
+	// Files we've pulled off the input queue and started reading ahead, but haven't scanned yet.
+	std::deque<std::shared_ptr<FileID>> readahead_files;
+
+	// Buffer for the pre-admission sniff of each file's first block.
+	ResizableArray<char> sniff_block;
+
+	// This thread's pre-admission stats, added to m_admission_stats when we're done.
+	DirTraversalStats stats;
+
+	{
+		std::lock_guard<std::mutex> lg {m_segment_mutex};
+		m_num_active_scanners++;
+	}
+
 	// Pull new filenames off the input queue until it's closed.
 	std::shared_ptr<FileID> next_file;
 	MatchList ml;
-	while(m_in_queue.pull_front(std::move(next_file)) != queue_op_status::closed)
+	while(true)
 	{
-		try
+		// If another thread is working on a big file, give it a hand before moving on to our next one.
 		{
-			// Try to open and read the file.  This could throw.
-			LOG(INFO) << "Attempting to scan file \'" << next_file->GetPath() << "\', fd=" << next_file->GetFileDescriptor();
+			std::unique_lock<std::mutex> lock {m_segment_mutex};
+			while(ScanNextSegment(thread_index, lock)) {};
+		}
+
+		// Top up the read-ahead window with whatever's already waiting in the queue, without blocking.
+		// The kernel fills the page cache for these while we're scanning the current file.
+		while(readahead_files.size() < f_readahead_depth
+				&& m_in_queue.try_pull_front(next_file) == queue_op_status::success)
+		{
+			File::Readahead(*next_file, f_readahead_max_bytes);
+			readahead_files.push_back(std::move(next_file));
+		}
+
+		if(!readahead_files.empty())
+		{
+			next_file = std::move(readahead_files.front());
+			readahead_files.pop_front();
+		}
+		else if(m_in_queue.pull_front(std::move(next_file)) == queue_op_status::closed)
+		{
+			// Nothing in flight and the queue is closed, we're done.
+			break;
+		}
 
-			steady_clock::time_point start = steady_clock::now();
+		// Small-file fast path.  Read this file and as many of the following small files as we have in flight
+		// into the slab, then scan them back-to-back.  The first file too big for this stays in next_file.
+		ScanSmallFiles(thread_index, next_file, readahead_files, *small_file_slab, ml, stats);
+		if(!next_file)
+		{
+			continue;
+		}
 
-			File f(next_file, file_data_storage);
+		// In background mode, evict this file from the page cache when we're done with it, however we leave this
+		// iteration.  Declared before the File below, so that any mapping of the file is gone by then.
+		struct PageCacheDropper
+		{
+			FileID *m_file_id;
+			~PageCacheDropper() { if(m_file_id != nullptr) { File::DropFromPageCache(*m_file_id); } }
+		} page_cache_dropper { m_drop_from_page_cache ? next_file.get() : nullptr };
 
-			steady_clock::time_point end = steady_clock::now();
-			accum_elapsed_time += (end - start);
+		try
+		{
+			// Try to open and read the file.  This could throw.
+			LOG(INFO) << "Attempting to scan file \'" << next_file->GetPath() << "\', fd=" << next_file->GetFileDescriptor();
 
-			auto bytes_read = f.size();
-			total_bytes_read += bytes_read;
-			LOG(INFO) << "Num/total bytes read: " << bytes_read << " / " << total_bytes_read;
+			// Open the file before getting its size, so the size comes from an fstat() of the open descriptor.
+			(void)next_file->GetFileDescriptor();
+			auto size_on_disk = static_cast<size_t>(next_file->GetFileSize());
 
-			if(f.size() == 0)
+			// Pre-admission checks.  Don't read any more of a file than we have to if we're not going to scan it.
+			if(m_max_filesize != 0 && size_on_disk > m_max_filesize)
 			{
-				LOG(INFO) << "WARNING: Filesize of \'" << f.name() << "\' is 0, skipping.";
+				LOG(INFO) << "File \'" << next_file->GetPath() << "\' is larger than --max-filesize, skipping.";
+				stats.m_num_files_rejected_too_large++;
 				continue;
 			}
+			if(!m_search_binary || !m_search_minified)
+			{
+				char *block = sniff_block.realloc(f_sniff_block_size, 64);
+				size_t block_len = File::ReadHead(*next_file, block, std::min(size_on_disk, f_sniff_block_size));
+				if(!PassesSniffTest(block, block_len, stats))
+				{
+					LOG(INFO) << "File \'" << next_file->GetPath() << "\' failed the pre-admission sniff test, skipping.";
+					continue;
+				}
+			}
 
-			const char *file_data = f.data();
-			size_t file_size = f.size();
+			if(m_scan_window_size != 0 && size_on_disk > m_scan_window_size && !File::IsMmapCandidate(size_on_disk, m_use_mmap))
+			{
+				// Too big to read in all at once.  Read and scan it a window at a time.
+				total_bytes_read += ScanFileInWindows(thread_index, *next_file, *file_data_storage, ml);
+			}
+			else
+			{
+				steady_clock::time_point start = steady_clock::now();
 
-			// Scan the file data for occurrences of the regex, sending matches to the MatchList ml.
-			ScanFile(thread_index, file_data, file_size, ml);
+				File f(next_file, file_data_storage, m_use_mmap);
 
-			if(!ml.empty())
-			{
-				ml.SetFilename(next_file->GetPath());
-				// Force move semantics here.
-				m_output_queue.push_back(std::move(ml));
-				ml.clear();
+				steady_clock::time_point end = steady_clock::now();
+				accum_elapsed_time += (end - start);
+
+				auto bytes_read = f.size();
+				total_bytes_read += bytes_read;
+				LOG(INFO) << "Num/total bytes read: " << bytes_read << " / " << total_bytes_read;
+				ThrottleReads(bytes_read);
+
+				if(f.size() == 0)
+				{
+					LOG(INFO) << "WARNING: Filesize of \'" << f.name() << "\' is 0, skipping.";
+					continue;
+				}
+
+				const char *file_data = f.data();
+				size_t file_size = f.size();
+
+				// Scan the file data for occurrences of the regex, sending matches to the MatchList ml.
+				ScanBuffer(thread_index, file_data, file_size, ml, false);
 			}
+
+			ReportResults(next_file->GetPath(), ml);
 		}
 		catch(const FileException &error)
 		{
 			// The File constructor threw an exception.
 			ERROR() << error.what();
 			LOG(DEBUG) << "Caught FileException: " << error.what();
+			// Don't let any partial results leak into the next file's MatchList.
+			ml.clear();
 		}
 		catch(const std::system_error& error)
 		{
 			// A system error.  Currently should only be errors from File.
 			ERROR() << error.code() << " - " << error.code().message();
 			LOG(DEBUG) << "Caught std::system_error: " << error.code() << " - " << error.code().message();
+			ml.clear();
 		}
 		catch(...)
 		{
@@ -184,276 +333,1548 @@ void FileScanner::Run(int thread_index)
 		}
 	}
 
+	// There are no more files for us to pull, but other threads may still be scanning big files.
+	// Stick around and help them until no thread can create any more segments.
+	{
+		std::unique_lock<std::mutex> lock {m_segment_mutex};
+		m_num_active_scanners--;
+		m_segment_cv.notify_all();
+		while(true)
+		{
+			m_segment_cv.wait(lock, [this](){ return !m_segmented_scans.empty() || m_num_active_scanners == 0; });
+			if(!ScanNextSegment(thread_index, lock))
+			{
+				// No segments left, and no other thread can create any more.
+				break;
+			}
+		}
+	}
+
+	m_admission_stats += stats;
+
 	duration<double> elapsed = duration_cast<duration<double>>(accum_elapsed_time);
 	LOG(INFO) << "Total bytes read = " << total_bytes_read << ", elapsed time = " << elapsed.count() << ", Bytes/Sec=" << total_bytes_read/elapsed.count() << std::endl;
 }
 
-void FileScanner::AssignToNextCore()
+void FileScanner::ScanSmallFiles(int thread_index, std::shared_ptr<FileID> &next_file,
+		std::deque<std::shared_ptr<FileID>> &readahead_files, ResizableArray<char> &slab, MatchList &ml,
+		DirTraversalStats &stats)
 {
-#ifdef HAVE_SCHED_SETAFFINITY
+	struct SmallFile
+	{
+		std::shared_ptr<FileID> m_file_id;
+		size_t m_offset;
+		size_t m_size;
+	};
+	std::vector<SmallFile> batch;
 
-	// Prevent the multiple threads from stepping on each other and screwing up m_next_core.
-	std::lock_guard<std::mutex> lg {f_assign_affinity_mutex};
+	char *slab_data = slab.realloc(f_small_file_slab_size, 64);
+	size_t slab_used = 0;
 
-	cpu_set_t cpuset;
+	// Read in as many small files as we can.
+	while(next_file && (slab_used + f_small_file_slot_size <= f_small_file_slab_size))
+	{
+		try
+		{
+			ssize_t file_size = File::ReadIfSmall(*next_file, slab_data + slab_used, f_small_file_max_size);
+			if(file_size < 0)
+			{
+				// Not a small file, leave it for the normal path.
+				break;
+			}
+			if(m_drop_from_page_cache)
+			{
+				// We have our own copy of the data now.
+				File::DropFromPageCache(*next_file);
+			}
+			ThrottleReads(file_size);
+			if(m_max_filesize != 0 && static_cast<size_t>(file_size) > m_max_filesize)
+			{
+				stats.m_num_files_rejected_too_large++;
+			}
+			else if((file_size > 0 || m_files_without_match) && PassesSniffTest(slab_data + slab_used, file_size, stats))
+			{
+				batch.push_back({std::move(next_file), slab_used, static_cast<size_t>(file_size)});
+				// Keep each file's data 64-byte aligned, and its zeroed padding intact.
+				slab_used += (file_size + 1024/8 + 63) & ~static_cast<size_t>(63);
+			}
+		}
+		catch(const FileException &error)
+		{
+			ERROR() << error.what();
+			LOG(DEBUG) << "Caught FileException: " << error.what();
+		}
+		catch(const std::system_error& error)
+		{
+			ERROR() << error.code() << " - " << error.code().message();
+			LOG(DEBUG) << "Caught std::system_error: " << error.code() << " - " << error.code().message();
+		}
 
-	// Clear the cpu_set_t.
-	CPU_ZERO(&cpuset);
+		next_file.reset();
+		if(!readahead_files.empty())
+		{
+			next_file = std::move(readahead_files.front());
+			readahead_files.pop_front();
+		}
+		else if(m_in_queue.try_pull_front(next_file) != queue_op_status::success)
+		{
+			// Nothing else ready to go right now, scan what we have.
+			next_file.reset();
+		}
+	}
 
-	// Set the bit of the next CPU.
-	CPU_SET(m_next_core, &cpuset);
+	// Scan them all.
+	for(auto &small_file : batch)
+	{
+		ScanFile(thread_index, slab_data + small_file.m_offset, small_file.m_size, ml);
+		ReportResults(small_file.m_file_id->GetPath(), ml);
+	}
+}
 
-	sched_setaffinity(0, sizeof(cpu_set_t), &cpuset);
+void FileScanner::ReportResults(const std::string &path, MatchList &ml)
+{
+	size_t num_unmatched = ml.GetNumberOfUnmatchedLines();
+	if(num_unmatched != 0 && !(m_first_match_only && !ml.empty()))
+	{
+		// Don't let the results look complete when they aren't.  If we only needed to know whether the file matched
+		// and it did, they are.
+		WARN() << path << ": " << num_unmatched << (num_unmatched == 1 ? " line" : " lines")
+				<< " couldn't be matched within the match limits, results for this file may be incomplete.";
+	}
+	if(ml.empty() == m_files_without_match)
+	{
+		ml.SetFilename(path);
+		// Force move semantics here.
+		m_output_queue.push_back(std::move(ml));
+	}
+	ml.clear();
+}
 
-	// Increment so we use the next core the next time.
-	m_next_core++;
-	m_next_core %= std::thread::hardware_concurrency();
-#endif
+bool FileScanner::PassesSniffTest(const char * __restrict__ block, size_t block_len, DirTraversalStats &stats) const noexcept
+{
+	size_t longest_line = SniffBlock(block, block + block_len);
+
+	if(longest_line == SIZE_MAX)
+	{
+		if(!m_search_binary)
+		{
+			stats.m_num_files_rejected_binary++;
+			return false;
+		}
+	}
+	else if(longest_line >= f_minified_line_length && !m_search_minified)
+	{
+		stats.m_num_files_rejected_minified++;
+		return false;
+	}
+
+	return true;
 }
 
-//__attribute__((target("default")))
-size_t FileScanner::CountLinesSinceLastMatch_default(const char * __restrict__ prev_lineno_search_end,
-		const char * __restrict__ start_of_current_match) noexcept
+size_t FileScanner::ScanFileInWindows(int thread_index, FileID &file_id, ResizableArray<char> &storage, MatchList &ml)
 {
-	size_t num_lines_since_last_match = 0;
+	int file_descriptor = file_id.GetFileDescriptor();
+
+#ifdef HAVE_POSIX_FADVISE
+	// We're going to read the whole file sequentially, let the kernel know.
+	(void)posix_fadvise(file_descriptor, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+	// The window buffer is reused for every window of the file.  ResizableArray::realloc() gives us a
+	// trailing vector's worth of padding past the window, which we rely on below.
+	size_t window_size = m_scan_window_size;
+	char *window = storage.realloc(window_size, 4096);
+
+	// Matches in each window are numbered from line 1 of the window, and then offset by this.
+	size_t lines_before_window {0};
+	// Number of bytes at the start of the window left over from the previous one, i.e. its trailing partial line.
+	size_t carry {0};
+	size_t total_bytes_read {0};
+	MatchList window_ml;
 
-	const char * last_ptr = prev_lineno_search_end;
 	while(true)
 	{
-		last_ptr = (const char*)std::memchr((const void*)last_ptr, '\n', start_of_current_match-last_ptr);
-		if(last_ptr != NULL)
+		ssize_t bytes_read = File::Read(file_descriptor, window + carry, window_size - carry);
+		if(bytes_read < 0)
 		{
-			++num_lines_since_last_match;
-			++last_ptr;
+			throw FileException("read() error on file '" + file_id.GetPath() + "'", errno);
+		}
+		total_bytes_read += bytes_read;
+		ThrottleReads(bytes_read);
+
+		size_t valid_size = carry + bytes_read;
+		bool at_eof = (static_cast<size_t>(bytes_read) < window_size - carry);
+		size_t scan_size = valid_size;
+
+		if(at_eof)
+		{
+			// Keep the same zero padding a whole-file read would have.
+			std::memset(window + valid_size, 0, 1024/8);
 		}
 		else
 		{
-			break;
+			// Only scan up to and including the last newline in the window.  The partial line after it gets
+			// carried over to the start of the next window, so no line is ever split across two scans.
+			// memrchr() would be nice here, but it's a GNU extension.
+			std::reverse_iterator<const char*> rstart(window + valid_size);
+			std::reverse_iterator<const char*> rend(window);
+			auto last_eol_rit = std::find(rstart, rend, '\n');
+			if(last_eol_rit == rend)
+			{
+				// No newline at all, so we have a single line longer than the whole window.  Double the window and
+				// read more of the line into it, so that the line is still only ever scanned whole.
+				std::string partial_line(window, valid_size);
+				window_size *= 2;
+				window = storage.realloc(window_size, 4096);
+				std::memcpy(window, partial_line.data(), valid_size);
+				carry = valid_size;
+				LOG(INFO) << "Line longer than the scan window, growing the window to " << window_size << " bytes.";
+				continue;
+			}
+			scan_size = last_eol_rit.base() - window;
 		}
-	}
 
-	return num_lines_since_last_match;
-}
+		if(scan_size > 0)
+		{
+			auto lines_in_window = ScanBuffer(thread_index, window, scan_size, window_ml, true);
+			ml.Append(std::move(window_ml), lines_before_window);
+			window_ml.clear();
+			lines_before_window += lines_in_window;
+		}
 
-bool FileScanner::IsPatternLiteral(const std::string &regex) noexcept
-{
-	// Search the string for any of the PCRE2 metacharacters.  This will cause some false negatives (e.g. anything with escapes
-	// will be determined to be a non-literal), but is quick and easy.
-	auto metachar_pos = regex.find_first_of("\\^$.[]()?*+{}|");
+		if(m_first_match_only && !ml.empty())
+		{
+			// That's all we needed to know, don't bother reading the rest of the file.
+			break;
+		}
 
-	bool is_lit = (metachar_pos == std::string::npos);
+		if(at_eof)
+		{
+			break;
+		}
 
-	return is_lit;
+		carry = valid_size - scan_size;
+		std::memmove(window, window + scan_size, carry);
+	}
+
+	return total_bytes_read;
 }
 
-uint8_t FileScanner::GetLiteralPrefixLen(const std::string &regex) noexcept
+size_t FileScanner::ScanBuffer(int thread_index, const char * __restrict__ data, size_t size, MatchList &ml, bool count_lines)
 {
-	// Bail if there are any alternates anywhere in the pattern.  This avoids having to
-	// deal with situations like '(cat|cab|car|cot)', which is a likely an overall loss anyway.
-	auto alt_pos = regex.find_first_of('|');
-	if(alt_pos != std::string::npos)
-	{
-		return 1;
-	}
-
-	// Otherwise, keep going until we find something non-literal.
-	auto first_metachar_pos = regex.find_first_of("\\^$.[]()?*+{}");
-	if(first_metachar_pos == std::string::npos)
+	if(size < 2*f_segment_size)
 	{
-		// The whole regex was literal, we shouldn't have gotten here.
-		LOG(INFO) << "No non-literal chars in regex.";
-		return 1;
+		// Not worth splitting up.
+		ScanFile(thread_index, data, size, ml);
+		return (count_lines && !m_first_match_only) ? CountLinesSinceLastMatch(data, data + size) : 0;
 	}
 
-	if(first_metachar_pos > 1)
+	// Split the buffer into segments, each ending at a line boundary.
+	SegmentedScan scan;
+	scan.data = data;
+	size_t segment_start = 0;
+	while(segment_start < size)
 	{
-		// There is at least one possible additional literal char.
-		// "Possible" because the non-literal following it could "de-literalize" it; e.g.,
-		// 'abc*' has a literal prefix of only 'ab', not 'abc'.  We adjust for such situations here.
-		/// @note '{' here because it could be e.g. 'abc{0,1}'.  We could get fancier about this case.
-		if(std::string("?*{").find(regex[first_metachar_pos]) != std::string::npos)
+		size_t segment_end = size;
+		if(size - segment_start >= 2*f_segment_size)
 		{
-			// It was one of the optional modifiers.  Remove the last char.
-			--first_metachar_pos;
+			auto eol = static_cast<const char*>(std::memchr(data + segment_start + f_segment_size, '\n', size - segment_start - f_segment_size));
+			if(eol != nullptr)
+			{
+				segment_end = (eol - data) + 1;
+			}
 		}
+		scan.segments.emplace_back(segment_start, segment_end - segment_start);
+		segment_start = segment_end;
 	}
+	scan.results.resize(scan.segments.size());
+	scan.newline_counts.resize(scan.segments.size());
 
-	return std::min(first_metachar_pos, static_cast<decltype(first_metachar_pos)>(255));
-}
+	LOG(INFO) << "Scanning " << size << " bytes in " << scan.segments.size() << " segments.";
 
-/**
- * Default FileScanner::LiteralMatch() implementation.
- *
- * @param file_data
- * @param file_size
- * @param start_offset
- * @param ovector
- * @return
- */
-int FileScanner::LiteralMatch_default(const char *file_data, size_t file_size, size_t start_offset, size_t *ovector) const noexcept
-{
-	int rc = 0;
+	{
+		std::unique_lock<std::mutex> lock {m_segment_mutex};
 
-	const char* str_match = (const char*)memmem((const void*)(file_data+start_offset), file_size - start_offset,
-						(const void *)m_literal_search_string.get(), m_literal_search_string_len);
+		// Let the other threads know there's work to help with.
+		m_segmented_scans.push_back(&scan);
+		m_segment_cv.notify_all();
 
-	if(str_match == nullptr)
-	{
-		// No match.
-		rc = -1; // == PCRE[2]_ERROR_NOMATCH;
-		ovector[0] = file_size;
-		ovector[1] = file_size;
+		// Scan segments ourselves until they've all been claimed.
+		while(ScanNextSegment(thread_index, lock, &scan)) {};
+
+		// Wait for any segments still being scanned by other threads.
+		m_segment_cv.wait(lock, [&scan](){ return scan.num_done == scan.segments.size(); });
 	}
-	else
+
+	// Stitch the per-segment results together in order.  The line number offset of each segment is the prefix sum
+	// of the newline counts of all the segments before it.
+	size_t lines_before_segment = 0;
+	for(size_t i = 0; i < scan.segments.size(); ++i)
 	{
-		// Found a match.
-		rc = 1;
-		ovector[0] = str_match - file_data;
-		ovector[1] = ovector[0] + m_literal_search_string_len;
+		ml.Append(std::move(scan.results[i]), lines_before_segment);
+		lines_before_segment += scan.newline_counts[i];
 	}
 
-	return rc;
+	return lines_before_segment;
 }
 
-extern "C" void * resolve_CountLinesSinceLastMatch(void)
+bool FileScanner::ScanNextSegment(int thread_index, std::unique_lock<std::mutex> &lock, SegmentedScan *scan)
 {
-	void *retval;
+	const bool pick_any_scan = (scan == nullptr);
 
-	if(sys_has_sse4_2() && sys_has_popcnt())
+	if(pick_any_scan)
 	{
-		retval = reinterpret_cast<void*>(&FileScanner::CountLinesSinceLastMatch_sse4_2_popcnt);
+		if(m_segmented_scans.empty())
+		{
+			return false;
+		}
+		scan = m_segmented_scans.front();
 	}
-	else if(sys_has_sse4_2() && !sys_has_popcnt())
+
+	if(scan->match_found && scan->next_segment < scan->segments.size())
 	{
-		retval = reinterpret_cast<void*>(&FileScanner::CountLinesSinceLastMatch_sse4_2_no_popcnt);
+		// We only needed to know whether there was a match, and there was.  Retire the rest of the segments unscanned.
+		scan->num_done += scan->segments.size() - scan->next_segment;
+		scan->next_segment = scan->segments.size();
+		m_segmented_scans.erase(std::find(m_segmented_scans.begin(), m_segmented_scans.end(), scan));
+		if(scan->num_done == scan->segments.size())
+		{
+			m_segment_cv.notify_all();
+		}
+		if(pick_any_scan)
+		{
+			return ScanNextSegment(thread_index, lock);
+		}
 	}
-	else if(sys_has_sse2())
+
+	if(scan->next_segment == scan->segments.size())
 	{
-		retval = reinterpret_cast<void*>(&FileScanner::CountLinesSinceLastMatch_sse2);
+		return false;
 	}
-	else
+
+	// Claim the next segment.
+	size_t segment_index = scan->next_segment++;
+	if(scan->next_segment == scan->segments.size())
 	{
-		retval = reinterpret_cast<void*>(&FileScanner::CountLinesSinceLastMatch_default);
+		// That was the last unclaimed one, nobody else needs to see this scan.
+		m_segmented_scans.erase(std::find(m_segmented_scans.begin(), m_segmented_scans.end(), scan));
 	}
 
-	return retval;
-}
-
-/**
- * Resolver for FileScanner::LiteralMatch().
- *
- * @param obj
- * @return
- */
-decltype(FileScanner::LiteralMatch) FileScanner::resolve_LiteralMatch(FileScanner * obj [[maybe_unused]]) noexcept
-{
-	decltype(FileScanner::LiteralMatch) retval;
+	lock.unlock();
 
-	if(sys_has_sse4_2())
+	auto [offset, length] = scan->segments[segment_index];
+	const char *segment_data = scan->data + offset;
+	size_t newlines = m_first_match_only ? 0 : CountLinesSinceLastMatch(segment_data, segment_data + length);
+	try
 	{
-		retval = &FileScanner::LiteralMatch_sse4_2;
+		ScanFile(thread_index, segment_data, length, scan->results[segment_index]);
 	}
-	else
+	catch(const std::exception &e)
 	{
-		retval = &FileScanner::LiteralMatch_default;
+		// Report it and carry on, the owning thread is waiting for this segment to be marked done.
+		ERROR() << "Error while scanning segment: " << e.what();
 	}
 
-	return retval;
-}
+	lock.lock();
 
-bool FileScanner::ConstructCodeUnitTable(const uint8_t *pcre2_bitmap) noexcept
-{
-	uint16_t out_index = 0;
+	scan->newline_counts[segment_index] = newlines;
+	scan->match_found = scan->match_found || (m_first_match_only && !scan->results[segment_index].empty());
+	scan->num_done++;
+	if(scan->num_done == scan->segments.size())
+	{
+		// Wake up the thread waiting for this scan to complete.
+		m_segment_cv.notify_all();
+	}
+
+	return true;
+}
+
+void FileScanner::ThrottleReads(size_t bytes_read)
+{
+	using namespace std::chrono;
+
+	if(m_max_read_rate == 0 || bytes_read == 0)
+	{
+		return;
+	}
+
+	steady_clock::time_point wake_time;
+	{
+		std::lock_guard<std::mutex> lock {m_read_rate_mutex};
+
+		// Don't let time we spent not reading be banked for a later burst.
+		m_read_rate_next_free = std::max(m_read_rate_next_free, steady_clock::now());
+		m_read_rate_next_free += duration_cast<steady_clock::duration>(duration<double>(static_cast<double>(bytes_read) / m_max_read_rate));
+		wake_time = m_read_rate_next_free;
+	}
+
+	std::this_thread::sleep_until(wake_time);
+}
+
+void FileScanner::AssignToNextCore()
+{
+#ifdef HAVE_SCHED_SETAFFINITY
+
+	// Prevent the multiple threads from stepping on each other and screwing up m_next_core.
+	std::lock_guard<std::mutex> lg {f_assign_affinity_mutex};
+
+	cpu_set_t cpuset;
+
+	// Clear the cpu_set_t.
+	CPU_ZERO(&cpuset);
+
+	// Set the bit of the next CPU.
+	CPU_SET(m_next_core, &cpuset);
+
+	sched_setaffinity(0, sizeof(cpu_set_t), &cpuset);
+
+	// Increment so we use the next core the next time.
+	m_next_core++;
+	m_next_core %= std::thread::hardware_concurrency();
+#endif
+}
+
+//__attribute__((target("default")))
+size_t FileScanner::CountLinesSinceLastMatch_default(const char * __restrict__ prev_lineno_search_end,
+		const char * __restrict__ start_of_current_match) noexcept
+{
+	size_t num_lines_since_last_match = 0;
+
+	const char * last_ptr = prev_lineno_search_end;
+	while(true)
+	{
+		last_ptr = (const char*)std::memchr((const void*)last_ptr, '\n', start_of_current_match-last_ptr);
+		if(last_ptr != NULL)
+		{
+			++num_lines_since_last_match;
+			++last_ptr;
+		}
+		else
+		{
+			break;
+		}
+	}
+
+	return num_lines_since_last_match;
+}
+
+size_t FileScanner::SniffBlock_default(const char * __restrict__ cbegin, const char * __restrict__ cend) noexcept
+{
+	if(std::memchr(cbegin, '\0', cend-cbegin) != nullptr)
+	{
+		return SIZE_MAX;
+	}
+
+	size_t longest_line = 0;
+	const char *line_start = cbegin;
+	while(const char *eol = (const char*)std::memchr(line_start, '\n', cend-line_start))
+	{
+		longest_line = std::max(longest_line, static_cast<size_t>(eol - line_start));
+		line_start = eol + 1;
+	}
+
+	// The last line may not be terminated.
+	return std::max(longest_line, static_cast<size_t>(cend - line_start));
+}
+
+std::string FileScanner::CombinePatterns(const std::vector<std::string> &patterns, bool *pattern_is_literal,
+		std::vector<std::string> *pattern_regexes)
+{
+	if(patterns.size() == 1)
+	{
+		return patterns[0];
+	}
+
+	// Escape all the punctuation in a literal pattern.  A '\' followed by punctuation is always that punctuation.
+	auto append_escaped = [](std::string *out, const std::string &literal){
+		for(char c : literal)
+		{
+			if(std::ispunct(static_cast<unsigned char>(c)))
+			{
+				*out += '\\';
+			}
+			*out += c;
+		}
+	};
+
+	bool all_literal = *pattern_is_literal || std::all_of(patterns.cbegin(), patterns.cend(), IsPatternLiteral);
+
+	std::string combined;
+	for(size_t i = 0; i < patterns.size(); ++i)
+	{
+		if(i > 0)
+		{
+			combined += '|';
+		}
+
+		if(all_literal)
+		{
+			// Which pattern matched will be the first one equal to the matched text, ignoring case if we are.
+			append_escaped(&combined, patterns[i]);
+			continue;
+		}
+
+		// The mark goes after the pattern, where it doesn't keep libpcre2 from working out the regex's possible
+		// first code units.
+		std::string pattern_regex = "(?:";
+		if(*pattern_is_literal)
+		{
+			append_escaped(&pattern_regex, patterns[i]);
+		}
+		else
+		{
+			pattern_regex += patterns[i];
+			if(patterns[i].find("\\Q") != std::string::npos)
+			{
+				// End any '\Q' quoting the pattern leaves open, so it doesn't swallow the rest of the regex.  An '\E'
+				// without a '\Q' is ignored.
+				pattern_regex += "\\E";
+			}
+		}
+		pattern_regex += ')';
+		combined += pattern_regex + "(*MARK:" + std::to_string(i+1) + ")";
+		pattern_regexes->push_back(std::move(pattern_regex));
+	}
+
+	*pattern_is_literal = false;
+
+	LOG(INFO) << "Combined " << patterns.size() << " patterns into regex '" << combined << "'.";
+
+	return combined;
+}
+
+std::string FileScanner::StripPatternMarks(std::string regex)
+{
+	for(auto mark = regex.find("(*MARK:"); mark != std::string::npos; mark = regex.find("(*MARK:", mark))
+	{
+		auto end = regex.find_first_not_of("0123456789", mark+7);
+		if(end == std::string::npos || regex[end] != ')' || end == mark+7)
+		{
+			break;
+		}
+		regex.erase(mark, end+1-mark);
+	}
+
+	return regex;
+}
+
+bool FileScanner::IsPatternLiteral(const std::string &regex) noexcept
+{
+	// Search the string for any of the PCRE2 metacharacters.  This will cause some false negatives (e.g. anything with escapes
+	// will be determined to be a non-literal), but is quick and easy.
+	auto metachar_pos = regex.find_first_of("\\^$.[]()?*+{}|");
+
+	bool is_lit = (metachar_pos == std::string::npos);
+
+	return is_lit;
+}
+
+size_t FileScanner::GetLiteralPrefixLen(const std::string &regex) noexcept
+{
+	// Bail if there are any alternates anywhere in the pattern.  This avoids having to
+	// deal with situations like '(cat|cab|car|cot)', which is a likely an overall loss anyway.
+	auto alt_pos = regex.find_first_of('|');
+	if(alt_pos != std::string::npos)
+	{
+		return 1;
+	}
+
+	// Otherwise, keep going until we find something non-literal.
+	auto first_metachar_pos = regex.find_first_of("\\^$.[]()?*+{}");
+	if(first_metachar_pos == std::string::npos)
+	{
+		// The whole regex was literal, we shouldn't have gotten here.
+		LOG(INFO) << "No non-literal chars in regex.";
+		return 1;
+	}
+
+	if(first_metachar_pos > 1)
+	{
+		// There is at least one possible additional literal char.
+		// "Possible" because the non-literal following it could "de-literalize" it; e.g.,
+		// 'abc*' has a literal prefix of only 'ab', not 'abc'.  We adjust for such situations here.
+		/// @note '{' here because it could be e.g. 'abc{0,1}'.  We could get fancier about this case.
+		if(std::string("?*{").find(regex[first_metachar_pos]) != std::string::npos)
+		{
+			// It was one of the optional modifiers.  Remove the last char.
+			--first_metachar_pos;
+		}
+	}
+
+	return first_metachar_pos;
+}
+
+/**
+ * Returns the index of the last char of the group, character class, or quantifier starting at regex[i], or
+ * std::string::npos if it's unterminated or isn't understood.
+ */
+static size_t skip_regex_element(const std::string &regex, size_t i) noexcept
+{
+	switch(regex[i])
+	{
+	case '[':
+		// A ']' immediately after the '[' or '[^' is a literal.
+		++i;
+		if(i < regex.size() && regex[i] == '^')
+		{
+			++i;
+		}
+		if(i < regex.size() && regex[i] == ']')
+		{
+			++i;
+		}
+		for(; i < regex.size() && regex[i] != ']'; ++i)
+		{
+			if(regex[i] == '\\')
+			{
+				++i;
+			}
+			else if(regex.compare(i, 2, "[:") == 0)
+			{
+				// POSIX class, e.g. '[[:alpha:]]'.
+				i = regex.find(":]", i+2);
+				if(i == std::string::npos)
+				{
+					return i;
+				}
+				++i;
+			}
+		}
+		return (i < regex.size()) ? i : std::string::npos;
+	case '(':
+	{
+		int depth = 0;
+		for(; i < regex.size(); ++i)
+		{
+			if(regex[i] == '\\')
+			{
+				++i;
+			}
+			else if(regex[i] == '[')
+			{
+				i = skip_regex_element(regex, i);
+				if(i == std::string::npos)
+				{
+					return i;
+				}
+			}
+			else if(regex[i] == '(')
+			{
+				++depth;
+			}
+			else if(regex[i] == ')' && --depth == 0)
+			{
+				return i;
+			}
+		}
+		return std::string::npos;
+	}
+	case '{':
+	{
+		// Only treat it as a quantifier if it looks like one.  Otherwise libpcre2 treats the '{' as a literal, and we
+		// don't want to skip over whatever's after it.
+		auto close = regex.find('}', i);
+		if(close == std::string::npos || close == i+1
+			|| regex.find_first_not_of("0123456789,", i+1) != close)
+		{
+			return std::string::npos;
+		}
+		i = close;
+	}
+		[[fallthrough]];
+	case '?':
+	case '*':
+	case '+':
+		// Skip any lazy or possessive modifier too.
+		if(i+1 < regex.size() && (regex[i+1] == '?' || regex[i+1] == '+'))
+		{
+			++i;
+		}
+		return i;
+	default:
+		return i;
+	}
+}
+
+std::string FileScanner::GetRequiredLiteral(const std::string &regex) noexcept
+{
+	std::string longest;
+	std::string run;
+
+	auto end_run = [&](){
+		if(run.size() > longest.size())
+		{
+			longest = run;
+		}
+		run.clear();
+	};
+
+	for(size_t i = 0; i < regex.size(); ++i)
+	{
+		char c = regex[i];
+		bool is_literal = false;
+
+		switch(c)
+		{
+		case '\\':
+			if(i+1 == regex.size())
+			{
+				return "";
+			}
+			c = regex[++i];
+			if(std::ispunct(static_cast<unsigned char>(c)))
+			{
+				// Escaped punctuation is a literal.
+				is_literal = true;
+			}
+			else if(std::strchr("bBdDsSwWhHvVRAzZGnrtfae", c) == nullptr)
+			{
+				// Something with arguments (e.g. '\x41', '\p{L}', '\1'), or which messes with the match itself (e.g. '\K', '\Q').
+				// Not worth the trouble.
+				return "";
+			}
+			break;
+		case '|':
+			// A top-level alternation, so nothing in particular is required.
+			return "";
+		case ')':
+			// Unbalanced.
+			return "";
+		case '(':
+			// Groups may be optional or alternations, so we don't look inside them.  Lookarounds and atomic groups are fine
+			// to skip, but inline options (e.g. '(?i)') or anything fancier could change what the rest of the regex matches.
+			if(regex.compare(i, 2, "(*") == 0
+				|| (regex.compare(i, 2, "(?") == 0 && regex.compare(i, 3, "(?:") != 0 && regex.compare(i, 3, "(?=") != 0
+						&& regex.compare(i, 3, "(?!") != 0 && regex.compare(i, 4, "(?<=") != 0 && regex.compare(i, 4, "(?<!") != 0
+						&& regex.compare(i, 3, "(?>") != 0))
+			{
+				return "";
+			}
+			i = skip_regex_element(regex, i);
+			break;
+		case '[':
+			i = skip_regex_element(regex, i);
+			break;
+		case '.':
+		case '^':
+		case '$':
+			break;
+		case '?':
+		case '*':
+		case '+':
+		case '{':
+			// A quantifier with nothing before it.
+			return "";
+		case '\n':
+			// Can't be part of a match anyway.
+			break;
+		default:
+			is_literal = true;
+			break;
+		}
+
+		if(i == std::string::npos)
+		{
+			// Unterminated group or class.
+			return "";
+		}
+
+		// Is whatever we just saw quantified?
+		if(i+1 < regex.size() && std::strchr("?*+{", regex[i+1]) != nullptr)
+		{
+			if(is_literal && regex[i+1] == '+')
+			{
+				// One or more, so the first one is still required, but nothing after it is adjacent to it.
+				run.push_back(c);
+			}
+			end_run();
+			i = skip_regex_element(regex, i+1);
+			if(i == std::string::npos)
+			{
+				return "";
+			}
+		}
+		else if(is_literal)
+		{
+			run.push_back(c);
+		}
+		else
+		{
+			end_run();
+		}
+	}
+	end_run();
+
+	return longest;
+}
+
+std::string FileScanner::GetLineStartLiteral(const std::string &regex, std::string *indent, bool *indent_required) noexcept
+{
+	indent->clear();
+	*indent_required = false;
+
+	if(regex.empty() || regex[0] != '^' || regex.find('|') != std::string::npos)
+	{
+		// Not anchored the way we understand, or an alternation, e.g. '^foo|^bar', which we don't bother with.
+		return "";
+	}
+	size_t i = 1;
+
+	// Is there any indentation?  Each of these is paired with the bytes it can match on one line, a few more than it
+	// really can in some cases (e.g. 0xA0 for '\s'), which only costs us a false candidate now and then.
+	static const std::pair<std::string, std::string> indent_elements[] {
+		{"\\s", std::string(" \t\v\f\r\x85\xA0")}, {"\\h", std::string(" \t\xA0")},
+		{"[ \\t]", " \t"}, {"[\\t ]", " \t"}, {" ", " "}, {"\\t", "\t"}
+	};
+	for(const auto & [element, bytes] : indent_elements)
+	{
+		size_t q = i + element.size();
+		if(regex.compare(i, element.size(), element) == 0 && q < regex.size() && (regex[q] == '*' || regex[q] == '+'))
+		{
+			*indent = bytes;
+			*indent_required = (regex[q] == '+');
+			i = q+1;
+			if(i < regex.size() && (regex[i] == '?' || regex[i] == '+'))
+			{
+				// Lazy or possessive, which doesn't change which lines can match.
+				++i;
+			}
+			break;
+		}
+	}
+
+	std::string literal;
+	for(; i < regex.size(); ++i)
+	{
+		char c = regex[i];
+		if(c == '\\')
+		{
+			if(i+1 == regex.size() || !std::ispunct(static_cast<unsigned char>(regex[i+1])))
+			{
+				break;
+			}
+			// Escaped punctuation is a literal.
+			c = regex[++i];
+		}
+		else if(c == '\n' || std::strchr("^$.[]()?*+{", c) != nullptr)
+		{
+			break;
+		}
+
+		if(i+1 < regex.size() && std::strchr("?*{", regex[i+1]) != nullptr)
+		{
+			// Optional or repeated, so it's not part of the literal.
+			break;
+		}
+		literal.push_back(c);
+		if(i+1 < regex.size() && regex[i+1] == '+')
+		{
+			// One or more, so the first one is still part of it, but nothing after.
+			break;
+		}
+	}
+
+	if(!literal.empty() && indent->find(literal[0]) != std::string::npos)
+	{
+		// The indentation could eat the start of the literal, e.g. '^\s* x'.
+		literal.clear();
+	}
+
+	return literal;
+}
+
+bool FileScanner::GetLiteralAlternatives(const std::string &regex, std::vector<std::string> *alternatives, bool *is_whole_regex) noexcept
+{
+	alternatives->clear();
+
+	// Is the alternation wrapped in a group?
+	size_t i = 0;
+	bool in_group = false;
+	if(regex.compare(0, 3, "(?:") == 0)
+	{
+		i = 3;
+		in_group = true;
+	}
+	else if(regex.size() > 1 && regex[0] == '(' && regex[1] != '?')
+	{
+		i = 1;
+		in_group = true;
+	}
+
+	// Split the alternatives out, bailing at the first non-literal.
+	std::string alt;
+	bool group_closed = false;
+	for(; i < regex.size(); ++i)
+	{
+		char c = regex[i];
+		if(c == '\\')
+		{
+			// Only escaped punctuation is a literal.
+			if(i+1 == regex.size() || !std::ispunct(static_cast<unsigned char>(regex[i+1])))
+			{
+				return false;
+			}
+			alt.push_back(regex[++i]);
+		}
+		else if(c == '|' || (c == ')' && in_group))
+		{
+			alternatives->push_back(std::move(alt));
+			alt.clear();
+			if(c == ')')
+			{
+				group_closed = true;
+				++i;
+				break;
+			}
+		}
+		else if(std::strchr("^$.[]()?*+{}", c) != nullptr)
+		{
+			return false;
+		}
+		else
+		{
+			alt.push_back(c);
+		}
+	}
+	if(!in_group)
+	{
+		alternatives->push_back(std::move(alt));
+	}
+	else if(!group_closed)
+	{
+		return false;
+	}
+
+	if(alternatives->size() < 2)
+	{
+		return false;
+	}
+	for(const auto & a : *alternatives)
+	{
+		if(a.empty() || a.find('\n') != std::string::npos)
+		{
+			// An empty alternative matches everywhere, and literals can't match across lines.
+			return false;
+		}
+	}
+
+	*is_whole_regex = (i >= regex.size());
+	if(*is_whole_regex)
+	{
+		return true;
+	}
+
+	// There's more regex after the group.  It's only a usable prefix if the group isn't optional...
+	if(std::strchr("?*{", regex[i]) != nullptr)
+	{
+		return false;
+	}
+
+	// ...and the rest of the regex isn't an alternate of the whole thing, e.g. '(a|b)c|d'.
+	int depth = 0;
+	for(; i < regex.size(); ++i)
+	{
+		switch(regex[i])
+		{
+		case '\\':
+			++i;
+			break;
+		case '[':
+			// Skip the character class.  A ']' immediately after the '[' or '[^' is a literal.
+			++i;
+			if(i < regex.size() && regex[i] == '^')
+			{
+				++i;
+			}
+			if(i < regex.size() && regex[i] == ']')
+			{
+				++i;
+			}
+			while(i < regex.size() && regex[i] != ']')
+			{
+				if(regex[i] == '\\')
+				{
+					++i;
+				}
+				++i;
+			}
+			break;
+		case '(':
+			++depth;
+			break;
+		case ')':
+			--depth;
+			break;
+		case '|':
+			if(depth <= 0)
+			{
+				return false;
+			}
+			break;
+		default:
+			break;
+		}
+	}
+
+	return true;
+}
+
+int FileScanner::MultiLiteralMatch(const char *file_data, size_t file_size, size_t start_offset, size_t *ovector) const noexcept
+{
+	const char * const cend = file_data + file_size;
+	const char *str_match = nullptr;
+	size_t match_len = 0;
+
+	if(m_multi_literal->GetNumDFAStates() == 0)
+	{
+		// Small set.  Skip to the next char which could start one of the literals, and check them all there.
+		const char *p = file_data + start_offset;
+		while(p < cend)
+		{
+			p = FindFirstPossibleCodeUnit_default(p, cend - p);
+			if(p == cend)
+			{
+				break;
+			}
+			match_len = m_multi_literal->MatchAt(p, cend);
+			if(match_len != 0)
+			{
+				str_match = p;
+				break;
+			}
+			++p;
+		}
+	}
+	else
+	{
+		str_match = m_multi_literal->Find(file_data + start_offset, cend, &match_len);
+	}
+
+	if(str_match == nullptr)
+	{
+		// No match.
+		ovector[0] = file_size;
+		ovector[1] = file_size;
+		return -1; // == PCRE[2]_ERROR_NOMATCH;
+	}
+
+	// Found a match.
+	ovector[0] = str_match - file_data;
+	ovector[1] = ovector[0] + match_len;
+	return 1;
+}
+
+/**
+ * Default FileScanner::LiteralMatch() implementation.
+ *
+ * @param file_data
+ * @param file_size
+ * @param start_offset
+ * @param ovector
+ * @return
+ */
+int FileScanner::LiteralMatch_default(const char *file_data, size_t file_size, size_t start_offset, size_t *ovector) const noexcept
+{
+	int rc = 0;
+
+	const char* str_match = (const char*)memmem((const void*)(file_data+start_offset), file_size - start_offset,
+						(const void *)m_literal_search_string.get(), m_literal_search_string_len);
+
+	if(str_match == nullptr)
+	{
+		// No match.
+		rc = -1; // == PCRE[2]_ERROR_NOMATCH;
+		ovector[0] = file_size;
+		ovector[1] = file_size;
+	}
+	else
+	{
+		// Found a match.
+		rc = 1;
+		ovector[0] = str_match - file_data;
+		ovector[1] = ovector[0] + m_literal_search_string_len;
+	}
 
-	for(uint16_t i=0; i<256; ++i)
+	return rc;
+}
+
+int FileScanner::LiteralMatch_long(const char *file_data, size_t file_size, size_t start_offset, size_t *ovector) const noexcept
+{
+	const char *haystack_end = file_data + file_size;
+	const char *str_match = std::search(file_data + start_offset, haystack_end, *m_long_literal_searcher);
+
+	if(str_match == haystack_end)
 	{
-		if((pcre2_bitmap[i/8] & (0x01 << (i%8))) == 0)
+		// No match.
+		ovector[0] = file_size;
+		ovector[1] = file_size;
+		return -1; // == PCRE[2]_ERROR_NOMATCH;
+	}
+
+	// Found a match.
+	ovector[0] = str_match - file_data;
+	ovector[1] = ovector[0] + m_literal_search_string_len;
+	return 1;
+}
+
+/**
+ * How common each byte value is in source code, from 0 (rarest) to 255 (most common).
+ *
+ * Ranked by the average of each byte's frequency in C/C++, Python, Perl, JavaScript, and shell sources (each
+ * weighted equally, not by how much of each there was), e.g. the system headers and the Python standard library.
+ * It doesn't have to be exact: it's only used to pick which bytes of a literal to look for first, and in code the
+ * difference between a ' ' or 'e' and a 'Q' or '^' is huge.
+ */
+static constexpr std::array<uint8_t, 256> f_byte_frequency_rank {
+	  0,   1,   2,   3,   4,   5,   6,  46,   7, 237, 248,   8,  50,  71,   9,  10,
+	 11,  12,  13,  14,  15,  16,  17,  18,  19,  20,  21,  73,  22,  23,  24,  25,
+	255, 176, 231, 195, 199, 166, 178, 211, 233, 234, 202, 170, 230, 226, 236, 222,
+	223, 216, 200, 192, 194, 193, 188, 186, 184, 187, 214, 208, 174, 224, 183, 164,
+	168, 221, 191, 217, 201, 227, 198, 182, 181, 218, 162, 175, 212, 189, 210, 209,
+	207, 163, 213, 225, 220, 185, 172, 173, 179, 180, 161, 197, 190, 196, 159, 243,
+	165, 246, 229, 244, 242, 254, 239, 228, 238, 251, 171, 219, 245, 235, 250, 247,
+	241, 169, 252, 249, 253, 240, 206, 203, 215, 232, 167, 205, 177, 204, 160,  47,
+	154, 147, 137, 145, 113,  99,  97, 124, 141,  80,  83,  75, 106, 118,  74, 134,
+	108, 114,  93,  82, 155, 128, 144,  88, 111, 125,  98, 100, 131,  91, 130, 153,
+	102, 126,  87,  89, 138, 104,  78, 117, 109, 115,  81,  95,  90,  85, 135, 107,
+	129, 121, 103, 101, 136, 140,  92,  77, 148, 119, 122, 120, 105, 142, 110, 143,
+	 37,  38, 146, 152,  94,  96,  62,  49,  51,  63,  53,  64,  55,  48, 133,  84,
+	157, 150,  69,  60,  58, 116,  70, 112, 139, 127,  59,  57,  45,  39,  40,  41,
+	156, 149, 158,  76,  79,  86, 123,  66,  65,  67,  68,  61,  72,  56,  26, 132,
+	151,  52,  42,  54,  43,  27,  28,  44,  29,  30,  31,  32,  33,  34,  35,  36,
+};
+
+/**
+ * Returns the indexes of the two rarest bytes of [@a literal, @a literal+@a len), going by f_byte_frequency_rank.
+ * Prefers two different byte values, since e.g. the two 'Q's of "QQ" tell us no more than one does.
+ */
+static std::array<size_t, 2> find_rarest_bytes(const uint8_t *literal, size_t len, bool ignore_case) noexcept
+{
+	auto rank = [ignore_case](uint8_t c) -> uint8_t {
+		if(ignore_case && c >= 'a' && c <= 'z')
+		{
+			// Either case can match.
+			return std::max(f_byte_frequency_rank[c], f_byte_frequency_rank[c & ~0x20]);
+		}
+		return f_byte_frequency_rank[c];
+	};
+
+	std::array<size_t, 2> rarest {0, 0};
+	for(size_t i = 1; i < len; ++i)
+	{
+		if(rank(literal[i]) < rank(literal[rarest[0]]))
+		{
+			rarest[0] = i;
+		}
+	}
+
+	// The second one is the rarest of the bytes which aren't the first one, or any other position if they all are.
+	bool found_second = false;
+	for(size_t i = 0; i < len; ++i)
+	{
+		if(i == rarest[0])
 		{
-			// This bit isn't set, skip to the next one.
 			continue;
 		}
-		else
+		bool better = !found_second
+				|| (literal[rarest[1]] == literal[rarest[0]] && literal[i] != literal[rarest[0]])
+				|| (literal[i] != literal[rarest[0]] && rank(literal[i]) < rank(literal[rarest[1]]));
+		if(better)
 		{
-			/// @todo This depends on little-endianness.
-			m_compiled_cu_bitmap[out_index] = i;
-			out_index++;
+			rarest[1] = i;
+			found_second = true;
 		}
 	}
-	m_end_fpcu_table = out_index;
-	return true;
+	if(!found_second)
+	{
+		// Only one byte.
+		rarest[1] = rarest[0];
+	}
+
+	return rarest;
 }
 
-void FileScanner::ConstructRangePairTable() noexcept
+void FileScanner::SetLiteralSearchString(const char *literal, size_t len)
 {
-	// Vars for pair finding.
-	uint16_t out_pair_index = 0;
-	uint8_t first_range_char = 0, last_range_char = 0;
+	// Allocate enough room for the vectorized searches to load a whole vector at the end.
+	constexpr auto vec_size_bytes = 16;
+
+	m_literal_search_string_len = len;
+	size_t size_to_alloc = m_literal_search_string_len+1;
+	m_literal_search_string.reset(static_cast<uint8_t*>(overaligned_alloc(vec_size_bytes, size_to_alloc)));
+	std::memcpy(static_cast<void*>(m_literal_search_string.get()), static_cast<const void*>(literal), len);
+	m_literal_search_string.get()[len] = '\0';
+	if(m_ignore_case)
+	{
+		// Caseless literals are matched against a lowercased copy of the literal, folding the haystack as we go.
+		std::transform(m_literal_search_string.get(), m_literal_search_string.get()+len, m_literal_search_string.get(),
+				[](uint8_t c){ return ascii_tolower(c); });
+		m_literal_ignore_case = true;
+	}
+
+	auto rarest = find_rarest_bytes(m_literal_search_string.get(), len, m_literal_ignore_case);
+	m_literal_rare_offset[0] = rarest[0];
+	m_literal_rare_offset[1] = rarest[1];
+	LOG(INFO) << "Filtering literal search on '" << static_cast<char>(m_literal_search_string.get()[rarest[0]]) << "' at offset " << rarest[0]
+			<< " and '" << static_cast<char>(m_literal_search_string.get()[rarest[1]]) << "' at offset " << rarest[1] << ".";
 
-	if(m_end_fpcu_table == 0)
+	m_long_literal_searcher.reset();
+	if(!m_literal_ignore_case && len >= f_long_literal_len)
 	{
-		// No code unit table, can't be a ranges table.
-		LOG(DEBUG) << "No first-possible code unit table, skipping creation of range table.";
-		m_end_ranges_table = 0;
-		return;
+		// Long enough that two rare bytes don't narrow things down much, and the searcher can skip ahead
+		// by up to the literal's length at a time.  Unlike Horspool's, Boyer-Moore's good suffix shifts keep it linear
+		// on repetitive literals like a line of '='s.
+		const char *needle = reinterpret_cast<const char *>(m_literal_search_string.get());
+		m_long_literal_searcher = std::make_unique<std::boyer_moore_searcher<const char*>>(needle, needle+len);
+		LOG(INFO) << "Using Boyer-Moore search for " << len << "-byte literal.";
 	}
 
-	first_range_char = m_compiled_cu_bitmap[0];
-	last_range_char = first_range_char;
+	LiteralMatch = resolve_LiteralMatch(this);
+}
+
+/**
+ * Returns true if @a c is a "word" character ([A-Za-z0-9_]), the same as libpcre2's default tables with UCP off.
+ */
+static inline bool is_word_char(char c) noexcept
+{
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+/**
+ * Returns true if there's a word boundary ('\b') at @a offset in @a file_data.
+ */
+static inline bool is_word_boundary(const char *file_data, size_t file_size, size_t offset) noexcept
+{
+	bool word_before = (offset > 0) && is_word_char(file_data[offset-1]);
+	bool word_after = (offset < file_size) && is_word_char(file_data[offset]);
+	return word_before != word_after;
+}
 
-	for(uint16_t i=1; i<m_end_fpcu_table; ++i)
+int FileScanner::LiteralWordMatch(const char *file_data, size_t file_size, size_t start_offset, size_t *ovector) const noexcept
+{
+	while(start_offset < file_size)
 	{
-		// We're looking for the end of this range.
-		if(m_compiled_cu_bitmap[i] == last_range_char + 1)
+		int rc = (this->*LiteralMatch)(file_data, file_size, start_offset, ovector);
+		if(rc <= 0)
 		{
-			// We're still in the range.
-			++last_range_char;
+			return rc;
 		}
-		else
+
+		if(is_word_boundary(file_data, file_size, ovector[0]) && is_word_boundary(file_data, file_size, ovector[1]))
+		{
+			return rc;
+		}
+
+		// Not a whole word, look again starting at the next char.
+		start_offset = ovector[0] + 1;
+	}
+
+	// No match.
+	ovector[0] = file_size;
+	ovector[1] = file_size;
+	return -1; // == PCRE[2]_ERROR_NOMATCH;
+}
+
+/**
+ * Default FileScanner::LiteralMatchCaseless() implementation.
+ */
+int FileScanner::LiteralMatchCaseless_default(const char *file_data, size_t file_size, size_t start_offset, size_t *ovector) const noexcept
+{
+	const char * const needle = reinterpret_cast<const char *>(m_literal_search_string.get());
+	const size_t needle_len = m_literal_search_string_len;
+
+	for(size_t i = start_offset; needle_len <= file_size && i <= file_size - needle_len; ++i)
+	{
+		if(ascii_caseless_equal(file_data+i, needle, needle_len))
 		{
-			// Range has ended.
-			m_compiled_range_bitmap[out_pair_index] = first_range_char;
-			++out_pair_index;
-			m_compiled_range_bitmap[out_pair_index] = last_range_char;
-			++out_pair_index;
+			// Found a match.
+			ovector[0] = i;
+			ovector[1] = i + needle_len;
+			return 1;
+		}
+	}
+
+	// No match.
+	ovector[0] = file_size;
+	ovector[1] = file_size;
+	return -1; // == PCRE[2]_ERROR_NOMATCH;
+}
+
+extern "C" void * resolve_CountLinesSinceLastMatch(void)
+{
+	void *retval;
+
+#if HAVE_MULTIVERSION_AVX512BW
+	if(sys_has_avx512bw() && sys_has_popcnt())
+	{
+		return reinterpret_cast<void*>(&FileScanner::CountLinesSinceLastMatch_avx512bw);
+	}
+#endif
+#if HAVE_MULTIVERSION_AVX2
+	if(sys_has_avx2() && sys_has_popcnt())
+	{
+		return reinterpret_cast<void*>(&FileScanner::CountLinesSinceLastMatch_avx2);
+	}
+#endif
+
+	if(sys_has_sse4_2() && sys_has_popcnt())
+	{
+		retval = reinterpret_cast<void*>(&FileScanner::CountLinesSinceLastMatch_sse4_2_popcnt);
+	}
+	else if(sys_has_sse4_2() && !sys_has_popcnt())
+	{
+		retval = reinterpret_cast<void*>(&FileScanner::CountLinesSinceLastMatch_sse4_2_no_popcnt);
+	}
+	else if(sys_has_sse2())
+	{
+		retval = reinterpret_cast<void*>(&FileScanner::CountLinesSinceLastMatch_sse2);
+	}
+	else
+	{
+		retval = reinterpret_cast<void*>(&FileScanner::CountLinesSinceLastMatch_default);
+	}
+
+	return retval;
+}
+
+extern "C" void * resolve_SniffBlock(void)
+{
+	void *retval;
+
+#if HAVE_MULTIVERSION_AVX512BW
+	if(sys_has_avx512bw() && sys_has_popcnt())
+	{
+		return reinterpret_cast<void*>(&FileScanner::SniffBlock_avx512bw);
+	}
+#endif
+#if HAVE_MULTIVERSION_AVX2
+	if(sys_has_avx2() && sys_has_popcnt())
+	{
+		return reinterpret_cast<void*>(&FileScanner::SniffBlock_avx2);
+	}
+#endif
+
+	if(sys_has_sse4_2() && sys_has_popcnt())
+	{
+		retval = reinterpret_cast<void*>(&FileScanner::SniffBlock_sse4_2_popcnt);
+	}
+	else if(sys_has_sse4_2() && !sys_has_popcnt())
+	{
+		retval = reinterpret_cast<void*>(&FileScanner::SniffBlock_sse4_2_no_popcnt);
+	}
+	else if(sys_has_sse2())
+	{
+		retval = reinterpret_cast<void*>(&FileScanner::SniffBlock_sse2);
+	}
+	else
+	{
+		retval = reinterpret_cast<void*>(&FileScanner::SniffBlock_default);
+	}
+
+	return retval;
+}
+
+/**
+ * Resolver for FileScanner::LiteralMatch().
+ *
+ * @param obj
+ * @return
+ */
+decltype(FileScanner::LiteralMatch) FileScanner::resolve_LiteralMatch(FileScanner * obj) noexcept
+{
+	decltype(FileScanner::LiteralMatch) retval;
 
-			LOG(DEBUG) << "Found range pair: [" << first_range_char << ", " << last_range_char << "]";
+	if(obj->m_long_literal_searcher)
+	{
+		return &FileScanner::LiteralMatch_long;
+	}
 
-			// Set up for the next range.
-			first_range_char = m_compiled_cu_bitmap[i];
-			last_range_char = first_range_char;
+	if(obj->m_literal_ignore_case)
+	{
+#if HAVE_MULTIVERSION_AVX512BW
+		if(sys_has_avx512bw() && sys_has_popcnt())
+		{
+			return &FileScanner::LiteralMatchCaseless_avx512bw;
+		}
+#endif
+#if HAVE_MULTIVERSION_AVX2
+		if(sys_has_avx2() && sys_has_popcnt())
+		{
+			return &FileScanner::LiteralMatchCaseless_avx2;
+		}
+#endif
+		if(sys_has_sse4_2())
+		{
+			return &FileScanner::LiteralMatchCaseless_sse4_2;
 		}
+		return &FileScanner::LiteralMatchCaseless_default;
+	}
+
+#if HAVE_MULTIVERSION_AVX512BW
+	if(sys_has_avx512bw() && sys_has_popcnt())
+	{
+		return &FileScanner::LiteralMatch_avx512bw;
+	}
+#endif
+#if HAVE_MULTIVERSION_AVX2
+	if(sys_has_avx2() && sys_has_popcnt())
+	{
+		return &FileScanner::LiteralMatch_avx2;
+	}
+#endif
+
+	if(sys_has_sse4_2())
+	{
+		retval = &FileScanner::LiteralMatch_sse4_2;
+	}
+	else
+	{
+		retval = &FileScanner::LiteralMatch_default;
+	}
+
+	return retval;
+}
+
+decltype(FileScanner::find_first_of) FileScanner::resolve_find_first_of() noexcept
+{
+#if HAVE_MULTIVERSION_AVX512BW
+	if(sys_has_avx512bw() && sys_has_popcnt())
+	{
+		return &FileScanner::find_first_of_avx512bw;
+	}
+#endif
+#if HAVE_MULTIVERSION_AVX2
+	if(sys_has_avx2() && sys_has_popcnt())
+	{
+		return &FileScanner::find_first_of_avx2;
+	}
+#endif
+	if(sys_has_sse4_2() && sys_has_popcnt())
+	{
+		return &FileScanner::find_first_of_sse4_2_popcnt;
+	}
+	else if(sys_has_sse4_2())
+	{
+		return &FileScanner::find_first_of_sse4_2_no_popcnt;
 	}
+	return &FileScanner::find_first_of_default;
+}
+
+decltype(FileScanner::find) FileScanner::resolve_find() noexcept
+{
+#if HAVE_MULTIVERSION_AVX512BW
+	if(sys_has_avx512bw() && sys_has_popcnt())
+	{
+		return &FileScanner::find_avx512bw;
+	}
+#endif
+#if HAVE_MULTIVERSION_AVX2
+	if(sys_has_avx2() && sys_has_popcnt())
+	{
+		return &FileScanner::find_avx2;
+	}
+#endif
+	if(sys_has_sse4_2() && sys_has_popcnt())
+	{
+		return &FileScanner::find_sse4_2_popcnt;
+	}
+	else if(sys_has_sse4_2())
+	{
+		return &FileScanner::find_sse4_2_no_popcnt;
+	}
+	return &FileScanner::find_default;
+}
 
-	// Terminate the last pair.
-	m_compiled_range_bitmap[out_pair_index] = first_range_char;
-	++out_pair_index;
-	m_compiled_range_bitmap[out_pair_index] = last_range_char;
-	++out_pair_index;
-	LOG(DEBUG) << "Found range pair: [" << first_range_char << ", " << last_range_char << "]";
+const char * FileScanner::find_first_of_default(const char * __restrict__ cbegin, size_t len) const noexcept
+{
+	return std::find_first_of(cbegin, cbegin+len, m_compiled_cu_bitmap, m_compiled_cu_bitmap+m_end_fpcu_table);
+}
 
-	m_end_ranges_table = out_pair_index;
+const char * FileScanner::find_default(const char * __restrict__ cbegin, size_t len) const noexcept
+{
+	const char *retval = static_cast<const char *>(std::memchr(cbegin, m_compiled_cu_bitmap[0], len));
+	return (retval != nullptr) ? retval : cbegin+len;
 }
 
+bool FileScanner::ConstructCodeUnitTable(const uint8_t *pcre2_bitmap) noexcept
+{
+	uint16_t out_index = 0;
+
+	// For each high nibble, the low nibbles of the code units in the set which have it.
+	uint16_t rows[16] {0};
+
+	for(uint16_t i=0; i<256; ++i)
+	{
+		if((pcre2_bitmap[i/8] & (0x01 << (i%8))) == 0)
+		{
+			// This bit isn't set, skip to the next one.
+			continue;
+		}
+		else
+		{
+			/// @todo This depends on little-endianness.
+			m_compiled_cu_bitmap[out_index] = i;
+			out_index++;
+			rows[i >> 4] |= 0x01 << (i & 0x0F);
+		}
+	}
+	m_end_fpcu_table = out_index;
+
+	// Give each distinct nonempty row a bucket bit, and build the nibble tables from them.
+	uint16_t buckets[8] {0};
+	uint8_t num_buckets = 0;
+	std::fill(std::begin(m_nibble_lo_table), std::end(m_nibble_lo_table), 0);
+	std::fill(std::begin(m_nibble_hi_table), std::end(m_nibble_hi_table), 0);
+	for(uint8_t hi=0; hi<16; ++hi)
+	{
+		if(rows[hi] == 0)
+		{
+			continue;
+		}
+
+		uint8_t bucket = std::find(buckets, buckets+num_buckets, rows[hi]) - buckets;
+		if(bucket == num_buckets)
+		{
+			if(num_buckets < 8)
+			{
+				++num_buckets;
+			}
+			else
+			{
+				// Out of buckets.  Widen the one most like this row to cover it too.
+				bucket = std::min_element(buckets, buckets+8, [&](uint16_t a, uint16_t b){
+					return __builtin_popcount(a ^ rows[hi]) < __builtin_popcount(b ^ rows[hi]); }) - buckets;
+				LOG(DEBUG) << "First code unit set needs more than 8 nibble table buckets, merging row " << +hi
+						<< " into bucket " << +bucket;
+			}
+			buckets[bucket] |= rows[hi];
+		}
+		m_nibble_hi_table[hi] |= 0x01 << bucket;
+	}
+	for(uint8_t bucket=0; bucket<num_buckets; ++bucket)
+	{
+		for(uint8_t lo=0; lo<16; ++lo)
+		{
+			if(buckets[bucket] & (0x01 << lo))
+			{
+				m_nibble_lo_table[lo] |= 0x01 << bucket;
+			}
+		}
+	}
+
+	return true;
+}
 
 const char * FileScanner::FindFirstPossibleCodeUnit_default(const char * __restrict__ cbegin, size_t len) const noexcept
 {
 	const char *first_possible_cu = nullptr;
 	if(m_end_fpcu_table > 1)
 	{
-#if 0
-		first_possible_cu = std::find_first_of(cbegin, cbegin+len, m_compiled_cu_bitmap, m_compiled_cu_bitmap+m_end_fpcu_table);
-#else
-		first_possible_cu = find_first_of_sse4_2_popcnt(cbegin, len);
-#endif
+		first_possible_cu = (this->*find_first_of)(cbegin, len);
 	}
 	else if(m_end_fpcu_table == 1)
 	{
-#if 0
-		first_possible_cu = std::find(cbegin, cbegin+len, m_compiled_cu_bitmap[0]);
-		/// @note Tried memchr() here, no real difference.
-#else
-		first_possible_cu = find_sse4_2_popcnt(cbegin, len);
-#endif
+		first_possible_cu = (this->*find)(cbegin, len);
 	}
 	else
 	{
@@ -26,13 +26,22 @@
 #include <string>
 #include <memory>
 #include <functional>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <vector>
 
 #include "libext/FileID.h"
+#include "libext/DirTree.h"
 #include "sync_queue_impl_selector.h"
 #include "MatchList.h"
+#include "MultiLiteralMatcher.h"
+#include "ResizableArray.h"
 
 
 extern "C" void* resolve_CountLinesSinceLastMatch(void);
+extern "C" void* resolve_SniffBlock(void);
 
 
 /// The regular expression engines we support.
@@ -43,6 +52,7 @@ enum class RegexEngine
 	CXX11, 	//!< C++11's built-in <regex> support.
 	PCRE,	//!< The original libpcre.
 	PCRE2,	//!< libpcre2
+	HYPERSCAN,	//!< libhs (Hyperscan or Vectorscan) finding the lines for libpcre2 to match.
 
 #if HAVE_LIBPCRE2
 	DEFAULT = PCRE2,
@@ -63,6 +73,47 @@ struct FileScannerException : public std::runtime_error
 };
 
 
+/**
+ * The options FileScanner::Create() sets up a FileScanner with.
+ */
+struct ScannerOptions
+{
+	/// The regexes to search for.  More than one are combined into a single regex with FileScanner::CombinePatterns().
+	std::vector<std::string> patterns;
+	/// If not empty, each Match records the number given here for the pattern in patterns it matched.
+	std::vector<size_t> pattern_numbers;
+	bool ignore_case {false};
+	bool word_regexp {false};
+	bool pattern_is_literal {false};
+	/// If true, mmap() files large enough to benefit from it instead of read()ing them.
+	bool use_mmap {false};
+	/// Files larger than this which aren't mmap()ed are read and scanned this many bytes at a time.  0 means always
+	/// read the whole file.
+	size_t scan_window_size {0};
+	/// Files larger than this many bytes are skipped.  0 means no limit.
+	size_t max_filesize {0};
+	/// If false, files with a NUL byte in their first block are skipped.
+	bool search_binary {false};
+	/// If false, files with a very long line in their first block are skipped.
+	bool search_minified {false};
+	/// If true, only report which files match, stopping at each file's first match.
+	bool files_with_matches {false};
+	/// If true, only report which files don't match, stopping at each file's first match.
+	bool files_without_match {false};
+	/// If true, evict each file's pages from the page cache once it's been scanned.
+	bool drop_from_page_cache {false};
+	/// Maximum number of bytes per second to read, across all scanner threads.  0 means no limit.
+	size_t max_read_rate {0};
+	/// Limit on the regex engine's backtracking per match attempt.  0 means the engine's default.
+	size_t match_limit {0};
+	/// Milliseconds the regex engine may spend matching in each file before falling back to a matching strategy which
+	/// can't backtrack.  Only checked between match attempts, so a single attempt is bounded by match_limit, not this.
+	/// 0 means no limit.
+	size_t match_time_limit {0};
+	RegexEngine engine {RegexEngine::DEFAULT};
+};
+
+
 /**
  * Base class for the classes which do the actual regex scanning of the file contents.
  */
@@ -75,20 +126,34 @@ public:
 	 *
 	 * @param in_queue
 	 * @param output_queue
-	 * @param regex
-	 * @param ignore_case
-	 * @param word_regexp
-	 * @param pattern_is_literal
-	 * @param engine
+	 * @param options  What to search for and how.
 	 * @return
 	 */
 	static std::unique_ptr<FileScanner> Create(sync_queue<std::shared_ptr<FileID>> &in_queue,
 			sync_queue<MatchList> &output_queue,
-			std::string regex,
-			bool ignore_case,
-			bool word_regexp,
-			bool pattern_is_literal,
-			RegexEngine engine = RegexEngine::DEFAULT);
+			const ScannerOptions &options);
+
+	/**
+	 * Combine @a patterns into one regex which matches wherever any of them do.
+	 *
+	 * If all the patterns are literal, the result is a plain alternation of them, which the multi-literal search
+	 * handles, ignoring case itself if need be.  Otherwise each pattern is wrapped in its own group (so inline options like
+	 * '(?i)' don't leak into the others, and an unterminated '\Q' is ended), and followed by a '(*MARK:n)' naming its
+	 * 1-based index in @a patterns.
+	 *
+	 * @param patterns
+	 * @param pattern_is_literal  In: true if the patterns are to be treated as literal strings.  Out: false if they've
+	 *                            been escaped into the returned regex.
+	 * @param pattern_regexes     If the patterns were given '(*MARK:n)'s, set to each one's group, without its mark.
+	 * @return  The combined regex.
+	 */
+	[[nodiscard]] static std::string CombinePatterns(const std::vector<std::string> &patterns, bool *pattern_is_literal,
+			std::vector<std::string> *pattern_regexes);
+
+	/**
+	 * Returns @a regex without the '(*MARK:n)'s CombinePatterns() put in it, for matchers which don't support them.
+	 */
+	[[nodiscard]] static std::string StripPatternMarks(std::string regex);
 
 public:
 	FileScanner(sync_queue<std::shared_ptr<FileID>> &in_queue,
@@ -121,6 +186,14 @@ protected:
 	static size_t CountLinesSinceLastMatch_default(const char * __restrict__ prev_lineno_search_end,
 			const char * __restrict__ start_of_current_match) noexcept;
 
+	//__attribute__((target("avx512bw", "popcnt")))
+	static size_t CountLinesSinceLastMatch_avx512bw(const char * __restrict__ prev_lineno_search_end,
+			const char * __restrict__ start_of_current_match) noexcept;
+
+	//__attribute__((target("avx2", "popcnt")))
+	static size_t CountLinesSinceLastMatch_avx2(const char * __restrict__ prev_lineno_search_end,
+			const char * __restrict__ start_of_current_match) noexcept;
+
 	//__attribute__((target("sse4.2", "popcnt")))
 	static size_t CountLinesSinceLastMatch_sse4_2_popcnt(const char * __restrict__ prev_lineno_search_end,
 			const char * __restrict__ start_of_current_match) noexcept;
@@ -133,30 +206,61 @@ protected:
 	static size_t CountLinesSinceLastMatch_sse2(const char * __restrict__ prev_lineno_search_end,
 					const char * __restrict__ start_of_current_match) noexcept;
 
+	friend void* ::resolve_SniffBlock(void);
 
-	bool ConstructCodeUnitTable(const uint8_t *pcre2_bitmap) noexcept;
-	void ConstructRangePairTable() noexcept;
+	/**
+	 * Pre-admission sniff of the first block of a file.
+	 *
+	 * @returns  The length of the longest line in [cbegin, cend), or SIZE_MAX if the block contains a NUL byte.
+	 */
+	static size_t (*SniffBlock)(const char * __restrict__ cbegin, const char * __restrict__ cend) noexcept;
 
-	using FindFirstPossibleCodeUnit_type = std::function<const char *(const FileScanner&, const char * __restrict__ cbegin, size_t len)>;
+	static size_t SniffBlock_default(const char * __restrict__ cbegin, const char * __restrict__ cend) noexcept;
+	static size_t SniffBlock_avx512bw(const char * __restrict__ cbegin, const char * __restrict__ cend) noexcept;
+	static size_t SniffBlock_avx2(const char * __restrict__ cbegin, const char * __restrict__ cend) noexcept;
+	static size_t SniffBlock_sse4_2_popcnt(const char * __restrict__ cbegin, const char * __restrict__ cend) noexcept;
+	static size_t SniffBlock_sse4_2_no_popcnt(const char * __restrict__ cbegin, const char * __restrict__ cend) noexcept;
+	static size_t SniffBlock_sse2(const char * __restrict__ cbegin, const char * __restrict__ cend) noexcept;
 
-	static FindFirstPossibleCodeUnit_type resolve_FindFirstPossibleCodeUnit();
 
-	FindFirstPossibleCodeUnit_type FindFirstPossibleCodeUnit;
+	/**
+	 * Build m_compiled_cu_bitmap and the nibble tables from a PCRE2_INFO_FIRSTBITMAP-style bitmap of the code units
+	 * which can start a match.
+	 */
+	bool ConstructCodeUnitTable(const uint8_t *pcre2_bitmap) noexcept;
 
 	const char * FindFirstPossibleCodeUnit_default(const char * __restrict__ cbegin, size_t len) const noexcept;
 
-	const char * FindFirstPossibleCodeUnit_sse4_2(const char * __restrict__ cbegin, size_t len) const noexcept;
+	/**
+	 * Member function pointers to the multiversioned first-possible-code-unit search functions.  Each returns a pointer
+	 * to the first char in [cbegin, cbegin+len) which is in m_compiled_cu_bitmap (find_first_of), or equal to
+	 * m_compiled_cu_bitmap[0] (find), or cbegin+len if there isn't one.
+	 *
+	 * The vectorized find_first_of()s classify each byte with the nibble tables, so for the rare set which needs more
+	 * than 8 buckets (see m_nibble_lo_table) they may also stop at a char which isn't in the set.
+	 */
+	///@{
+	const char * (FileScanner::*find_first_of)(const char * __restrict__ cbegin, size_t len) const noexcept;
+	const char * (FileScanner::*find)(const char * __restrict__ cbegin, size_t len) const noexcept;
+	///@}
 
-	//friend void* ::resolve_find_first_of(void);
-	//__attribute__((target("default")))
-	const char * find_first_in_ranges_sse4_2_popcnt(const char * __restrict__ cbegin, size_t len) const noexcept;
+	/// Runtime resolvers for the above.
+	///@{
+	static decltype(find_first_of) resolve_find_first_of() noexcept;
+	static decltype(find) resolve_find() noexcept;
+	///@}
 
 	const char * find_first_of_default(const char * __restrict__ cbegin, size_t len) const noexcept;
 	const char * find_first_of_sse4_2_no_popcnt(const char * __restrict__ cbegin, size_t len) const noexcept;
 	const char * find_first_of_sse4_2_popcnt(const char * __restrict__ cbegin, size_t len) const noexcept;
+	const char * find_first_of_avx2(const char * __restrict__ cbegin, size_t len) const noexcept;
+	const char * find_first_of_avx512bw(const char * __restrict__ cbegin, size_t len) const noexcept;
 
+	const char * find_default(const char * __restrict__ cbegin, size_t len) const noexcept;
 	const char * find_sse4_2_no_popcnt(const char * __restrict__ cbegin, size_t len) const noexcept;
 	const char * find_sse4_2_popcnt(const char * __restrict__ cbegin, size_t len) const noexcept;
+	const char * find_avx2(const char * __restrict__ cbegin, size_t len) const noexcept;
+	const char * find_avx512bw(const char * __restrict__ cbegin, size_t len) const noexcept;
 
 	/**
 	 * Member function pointer to the multiversioned LiteralMatch function.
@@ -178,6 +282,31 @@ protected:
 
 	int LiteralMatch_sse4_2(const char *file_data, size_t file_size, size_t start_offset, size_t *ovector) const noexcept;
 
+	int LiteralMatch_avx2(const char *file_data, size_t file_size, size_t start_offset, size_t *ovector) const noexcept;
+
+	int LiteralMatch_avx512bw(const char *file_data, size_t file_size, size_t start_offset, size_t *ovector) const noexcept;
+
+	/**
+	 * LiteralMatch() for literals of f_long_literal_len or longer, using m_long_literal_searcher.  Not multiversioned,
+	 * the searcher's skip tables do better than the vectorized rare byte filters here.
+	 */
+	int LiteralMatch_long(const char *file_data, size_t file_size, size_t start_offset, size_t *ovector) const noexcept;
+
+	/**
+	 * Find the first match of m_literal_search_string with LiteralMatch() which has a word boundary at both ends,
+	 * as libpcre2 would for '\b(?:literal)\b'.  Used for --word-regexp.
+	 */
+	int LiteralWordMatch(const char *file_data, size_t file_size, size_t start_offset, size_t *ovector) const noexcept;
+
+	/// Versions of the above which ignore ASCII case, for when m_literal_ignore_case is set.
+	int LiteralMatchCaseless_default(const char *file_data, size_t file_size, size_t start_offset, size_t *ovector) const noexcept;
+
+	int LiteralMatchCaseless_sse4_2(const char *file_data, size_t file_size, size_t start_offset, size_t *ovector) const noexcept;
+
+	int LiteralMatchCaseless_avx2(const char *file_data, size_t file_size, size_t start_offset, size_t *ovector) const noexcept;
+
+	int LiteralMatchCaseless_avx512bw(const char *file_data, size_t file_size, size_t start_offset, size_t *ovector) const noexcept;
+
 	///@}
 
 	/**
@@ -192,7 +321,50 @@ protected:
 	 * @param regex
 	 * @return
 	 */
-	static uint8_t GetLiteralPrefixLen(const std::string &regex) noexcept;
+	static size_t GetLiteralPrefixLen(const std::string &regex) noexcept;
+
+	/**
+	 * Analyzes the given @c regex and finds the longest literal string which every match of it must contain,
+	 * e.g. '_handler(' for '\w+_handler\('.  Only the top level of the regex is examined; groups, classes, and
+	 * anything optional or repeated end a literal.  Regexes with a top-level alternation, inline options, or escapes
+	 * which aren't understood have no required literal.
+	 *
+	 * @returns  The required literal with escapes removed, or an empty string if none was found.
+	 */
+	static std::string GetRequiredLiteral(const std::string &regex) noexcept;
+
+	/**
+	 * Analyzes the given @c regex, which libpcre2 has told us can only match at the start of a line, and finds the literal
+	 * string which every match starts with after the '^' and any indentation; e.g. '#include' for '^\s*#include\s*<'.
+	 * Only a '^' followed by an optional repeated '\s', '\h', '[ \t]', ' ', or '\t' and then literal chars is
+	 * understood.
+	 *
+	 * @param regex
+	 * @param indent           Set to the bytes the indentation can be made of, or to an empty string if there is none.
+	 * @param indent_required  Set to true if there has to be at least one byte of indentation.
+	 * @returns  The literal with escapes removed, or an empty string if none was found.
+	 */
+	static std::string GetLineStartLiteral(const std::string &regex, std::string *indent, bool *indent_required) noexcept;
+
+	/**
+	 * Analyzes the given @c regex and determines if it is, or begins with, an alternation of two or more literal strings;
+	 * e.g. 'TODO|FIXME|XXX' or '(?:malloc|calloc|realloc)\s*\('.
+	 *
+	 * @param regex
+	 * @param alternatives    Filled with the literal alternatives, in order, with escapes removed.
+	 * @param is_whole_regex  Set to true if the alternation is the entire regex, false if it's only a prefix of it.
+	 * @returns  true if @c regex is or starts with such an alternation.
+	 */
+	static bool GetLiteralAlternatives(const std::string &regex, std::vector<std::string> *alternatives, bool *is_whole_regex) noexcept;
+
+	/**
+	 * Find the first match of any of the m_multi_literal strings, with the same interface as LiteralMatch().
+	 */
+	int MultiLiteralMatch(const char *file_data, size_t file_size, size_t start_offset, size_t *ovector) const noexcept;
+
+	/// Sets of literals of this size or smaller are searched for by scanning for their first chars with
+	/// FindFirstPossibleCodeUnit_default() and checking each literal there, larger sets with m_multi_literal's DFA.
+	static constexpr size_t f_max_first_cu_scan_literals = 8;
 
 
 	/// The original regex (as a std::string) passed in during construction.
@@ -210,11 +382,17 @@ protected:
 	/// 1+index of last valid value in m_compiled_cu_bitmap.
 	uint16_t m_end_fpcu_table {0};
 
-	/// Array used to match character ranges.
-	alignas(16) uint8_t m_compiled_range_bitmap[256];
-
-	/// One past the end of the last valid value in m_compiled_range_bitmap.
-	uint16_t m_end_ranges_table {0};
+	/**
+	 * @name Nibble tables for the vectorized find_first_of()s.
+	 * The high nibbles whose rows of the 16x16 code unit bitmap are the same share one of 8 bucket bits.  A byte is in
+	 * the set if m_nibble_lo_table[byte & 0x0F] & m_nibble_hi_table[byte >> 4] is nonzero, which takes two pshufbs
+	 * per vector, however many code units the set has.  A set with more than 8 distinct nonempty rows (which can't
+	 * happen for an ASCII-only set) merges the extras into the last bucket, so it gets the occasional false hit.
+	 */
+	///@{
+	alignas(16) uint8_t m_nibble_lo_table[16] {0};
+	alignas(16) uint8_t m_nibble_hi_table[16] {0};
+	///@}
 
 	/**
 	 * The literal string to search for.  This string has been allocated by overaligned_alloc(), and so must be
@@ -223,12 +401,73 @@ protected:
 	std::unique_ptr<uint8_t,void(*)(void*)> m_literal_search_string { nullptr, std::free };
 	size_t m_literal_search_string_len {0};
 
+	/**
+	 * Offsets into m_literal_search_string of its two rarest bytes (in source code, going by f_byte_frequency_rank),
+	 * which the vectorized LiteralMatch()es compare each haystack position against before doing a full compare.
+	 * The same offset twice if the literal is only one byte long.
+	 */
+	size_t m_literal_rare_offset[2] {0, 0};
+
+	/**
+	 * Set m_literal_search_string to @a literal, lowercased if we're ignoring case, find its rarest bytes, and pick
+	 * the LiteralMatch() implementation for its length.
+	 *
+	 * @param literal
+	 * @param len
+	 */
+	void SetLiteralSearchString(const char *literal, size_t len);
+
+	/// Literals this long or longer are searched for with m_long_literal_searcher.
+	static constexpr size_t f_long_literal_len = 256;
+
+	/// Boyer-Moore searcher for m_literal_search_string, if it's f_long_literal_len or longer and caseful.
+	std::unique_ptr<std::boyer_moore_searcher<const char*>> m_long_literal_searcher;
+
 	/// Flag set by regex analysis if matching should use m_literal_search_string as the full literal string to match.
 	bool m_use_literal {false};
 
 	/// Flag set by regex analysis if matching should use m_literal_search_string as the literal prefix of a larger regular expression.
 	bool m_use_lit_prefix {false};
 
+	/// Flag set by regex analysis if matching should use m_literal_search_string as a literal somewhere inside a larger regular
+	/// expression.  Each line containing it is handed to the regex engine on its own.
+	bool m_use_inner_literal {false};
+
+	/// Flag set by regex analysis if m_literal_search_string has been lowercased and should be matched ignoring case.
+	bool m_literal_ignore_case {false};
+
+	/// The literals of a regex which is, or starts with, an alternation of literals.
+	std::unique_ptr<MultiLiteralMatcher> m_multi_literal;
+
+	/// Flag set by regex analysis if matching should use m_multi_literal as the full set of literals to match.
+	bool m_use_multi_literal {false};
+
+	/// Flag set by regex analysis if matching should use m_multi_literal as the alternatives at the start of a larger regular expression.
+	bool m_use_multi_lit_prefix {false};
+
+	/// If true, ScanFile() stops at the first match and only marks the MatchList as matched with
+	/// MatchList::SetFileMatched(), without constructing any Matches or counting lines.
+	bool m_first_match_only {false};
+
+	/// If true, report files which don't match instead of files which do.
+	bool m_files_without_match {false};
+
+	/// Limit on the backtracking the regex engine may do in one match attempt.  0 means the engine's default.
+	size_t m_match_limit {0};
+
+	/// Milliseconds the regex engine may spend matching in one file before it falls back to matching the rest of the
+	/// file a way which can't backtrack.  libpcre2 can't be interrupted mid-match, so this is only checked after each
+	/// match attempt returns; m_match_limit is what bounds any single attempt.  0 means no limit.
+	size_t m_match_time_limit {0};
+
+	/// The number to report for each of the patterns combined into the regex, if each Match is to report which one it
+	/// matched, else empty.
+	std::vector<size_t> m_pattern_numbers;
+
+	/// The regex for each of the patterns, if CombinePatterns() marked them, for telling which one matched where the
+	/// marks aren't available.  Else empty.
+	std::vector<std::string> m_pattern_regexes;
+
 private:
 
 	/**
@@ -249,14 +488,164 @@ private:
 	 */
 	virtual void ScanFile(int thread_index, const char * __restrict__ file_data, size_t file_size, MatchList &ml) = 0;
 
+	/**
+	 * Small-file fast path.  Reads @a next_file, followed by as many files from @a readahead_files and then the input
+	 * queue as will fit, into @a slab as long as they're small, then scans them back-to-back.  This skips the stat(), posix_fadvise(), and
+	 * large aligned buffer the File path uses, which for small files cost more than the read itself.
+	 *
+	 * @param next_file        On entry, the next file to scan.  On return, the first file which was too big for the
+	 *                         fast path and needs to be scanned normally, or empty if there isn't one.
+	 * @param readahead_files  Files already pulled off the input queue.  Files are taken from the front of this
+	 *                         before pulling any more off the queue.
+	 * @param slab             Buffer to read the batch of small files into.
+	 * @param ml               Scratch MatchList.  Matches are sent to the output queue per file.
+	 */
+	void ScanSmallFiles(int thread_index, std::shared_ptr<FileID> &next_file,
+			std::deque<std::shared_ptr<FileID>> &readahead_files, ResizableArray<char> &slab, MatchList &ml,
+			DirTraversalStats &stats);
+
+	/**
+	 * Pre-admission check, run on the first block of a file before we go to the trouble of reading and scanning all of it.
+	 * Rejects binary files (any NUL bytes) unless m_search_binary is set, and minified files (any line longer than
+	 * f_minified_line_length) unless m_search_minified is set.  Rejections are counted in @a stats.
+	 *
+	 * @param block      The first up-to-f_sniff_block_size bytes of the file.
+	 * @param block_len  Length of @a block.
+	 * @returns  true if the file should be scanned.
+	 */
+	bool PassesSniffTest(const char * __restrict__ block, size_t block_len, DirTraversalStats &stats) const noexcept;
+
+	/**
+	 * Send the results of scanning the file at @a path to the output queue, if there's anything to report.
+	 * Normally that's any matches in @a ml, but with m_files_without_match it's the lack of them.
+	 * Warns on stderr if any lines of the file couldn't be matched.  @a ml is cleared either way.
+	 */
+	void ReportResults(const std::string &path, MatchList &ml);
+
+	/**
+	 * Read and scan the file described by @a file_id in windows of m_scan_window_size bytes, so that memory usage is
+	 * bounded regardless of the file's size.  Each window ends on a line boundary, with any trailing partial line
+	 * carried over into the next window, and line numbers are carried across windows.  A line longer than the window
+	 * grows the window until it fits, so lines are always scanned whole.  Matches are added to @a ml.
+	 *
+	 * @param thread_index  Index of the calling scanner thread.
+	 * @param file_id       The file to scan.
+	 * @param storage       Buffer to use for the window.
+	 * @param ml            MatchList to add any matches to.
+	 * @return  The number of bytes read.
+	 */
+	size_t ScanFileInWindows(int thread_index, FileID &file_id, ResizableArray<char> &storage, MatchList &ml);
+
+	/**
+	 * If there's an m_max_read_rate, account for @a bytes_read more bytes having been read, and sleep as long as
+	 * necessary to keep the total read rate of all scanner threads under it.
+	 */
+	void ThrottleReads(size_t bytes_read);
+
+	/**
+	 * Scan @a data for matches, adding them to @a ml.  If @a data is large enough, it's split at line boundaries into
+	 * segments which any idle scanner threads will help scan, and the calling thread doesn't return until all
+	 * segments are done.  Matches are added to @a ml in file order with correct line numbers regardless.
+	 *
+	 * @param count_lines  If true, the return value is the number of newlines in @a data.
+	 * @return  The number of newlines in @a data if @a count_lines is true or the data was segmented, 0 otherwise.
+	 */
+	size_t ScanBuffer(int thread_index, const char * __restrict__ data, size_t size, MatchList &ml, bool count_lines);
+
+	/**
+	 * A buffer which has been split into segments which can be scanned by any scanner thread.
+	 * All members other than data and segments are protected by m_segment_mutex.
+	 */
+	struct SegmentedScan
+	{
+		/// The buffer being scanned.
+		const char *data;
+		/// Offset and length of each segment.  Every segment but the last ends in a newline.
+		std::vector<std::pair<size_t, size_t>> segments;
+		/// Matches found in each segment, with line numbers relative to the start of the segment.
+		std::vector<MatchList> results;
+		/// Number of newlines in each segment, for converting to absolute line numbers.
+		std::vector<size_t> newline_counts;
+		/// Index of the next segment to be claimed by a thread.
+		size_t next_segment {0};
+		/// Number of segments which have been completely scanned.
+		size_t num_done {0};
+		/// In m_first_match_only mode, set once any segment has matched.  No more segments need to be scanned.
+		bool match_found {false};
+	};
+
+	/**
+	 * Claim and scan the next unclaimed segment of @a scan, or if @a scan is nullptr, of any pending SegmentedScan.
+	 *
+	 * @param lock  Lock on m_segment_mutex.  Must be held on entry, will be held on return, but is released during the scan.
+	 * @return  false if there was no unclaimed segment to scan.
+	 */
+	bool ScanNextSegment(int thread_index, std::unique_lock<std::mutex> &lock, SegmentedScan *scan = nullptr);
+
 	sync_queue<std::shared_ptr<FileID>>& m_in_queue;
 
 	sync_queue<MatchList> &m_output_queue;
 
 	int m_next_core;
 
+	/// Passed to the File constructor.  If true, large files are mmap()ed instead of read().
 	bool m_use_mmap;
 
+	/// Files larger than this which aren't going to be mmap()ed are scanned by ScanFileInWindows().  0 disables windowing.
+	size_t m_scan_window_size {0};
+
+	/// @name Pre-admission checks.
+	/// @{
+
+	/// Files larger than this are skipped without being read.  0 means no limit.
+	size_t m_max_filesize {0};
+
+	/// If false, files which look binary are skipped.
+	bool m_search_binary {false};
+
+	/// If false, files which look minified are skipped.
+	bool m_search_minified {false};
+
+
+	/// Sum of all Run() threads' pre-admission rejection counts.
+	DirTraversalStats m_admission_stats;
+
+	/// @}
+
+	/// @name Background mode.
+	/// @{
+
+	/// If true, each file's pages are evicted from the page cache once we're done with it.
+	bool m_drop_from_page_cache {false};
+
+	/// Maximum total bytes per second to read.  0 means no limit.
+	size_t m_max_read_rate {0};
+
+	/// Protects m_read_rate_next_free.
+	std::mutex m_read_rate_mutex;
+
+	/// The time at which all bytes read so far will have been "paid for" at m_max_read_rate.
+	std::chrono::steady_clock::time_point m_read_rate_next_free {};
+
+	/// @}
+
+	/// @name Intra-file parallel scanning.
+	/// @{
+
+	/// Protects m_segmented_scans, m_num_active_scanners, and the non-const members of the SegmentedScans.
+	std::mutex m_segment_mutex;
+
+	/// Notified when a SegmentedScan is added or completed, or when a scanner thread stops pulling files.
+	std::condition_variable m_segment_cv;
+
+	/// SegmentedScans which still have unclaimed segments.
+	std::deque<SegmentedScan*> m_segmented_scans;
+
+	/// Number of Run() threads which may still pull files off the input queue, and so may still create SegmentedScans.
+	int m_num_active_scanners {0};
+
+	/// @}
+
 	/**
 	 * Switch to make Run() assign its std::thread to different cores on the machine.
 	 * If false, the underlying std::thread logic is allowed to decide which threads run on
@@ -0,0 +1,223 @@
+/*
+ * Copyright 2022 Gary R. Van Sickle (grvs@users.sourceforge.net).
+ *
+ * This file is part of UniversalCodeGrep.
+ *
+ * UniversalCodeGrep is free software: you can redistribute it and/or modify it under the
+ * terms of version 3 of the GNU General Public License as published by the Free
+ * Software Foundation.
+ *
+ * UniversalCodeGrep is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * UniversalCodeGrep.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file FileScannerHyperscan.cpp */
+
+#include <config.h>
+
+#include "FileScannerHyperscan.h"
+
+#include <libext/Logger.h>
+#include <cstring>
+#include <algorithm>
+#include <iterator>
+#include <limits>
+
+#if HAVE_LIBHYPERSCAN
+/// What FindCandidateLine() needs to know about the libhs match reports from one hs_scan() call.
+struct hs_first_match
+{
+	/// Reports of matches ending at or before this offset are of matches starting before the offset libpcre2 will
+	/// start at, and are ignored.
+	unsigned long long m_min_end;
+
+	/// The end offset of the first report not ignored.
+	unsigned long long m_end;
+};
+
+/**
+ * libhs match callback.  libhs reports matches in order of their end offsets, so the first one we don't ignore is the
+ * one we want, and we tell libhs to stop scanning.
+ */
+static int on_hs_match(unsigned int id, unsigned long long from, unsigned long long to, unsigned int flags, void *context)
+{
+	(void)id;
+	(void)from;
+	(void)flags;
+
+	hs_first_match *fm = static_cast<hs_first_match*>(context);
+
+	if(to <= fm->m_min_end)
+	{
+		// Keep going.
+		return 0;
+	}
+
+	fm->m_end = to;
+	return 1;
+}
+#endif  // HAVE_LIBHYPERSCAN
+
+FileScannerHyperscan::FileScannerHyperscan(sync_queue<std::shared_ptr<FileID>> &in_queue,
+		sync_queue<MatchList> &output_queue,
+		std::string regex,
+		bool ignore_case,
+		bool word_regexp,
+		bool pattern_is_literal)
+#if HAVE_LIBHYPERSCAN
+		: FileScannerHyperscan(in_queue, output_queue, regex, ignore_case, word_regexp, pattern_is_literal,
+				CompileDatabase(regex, ignore_case, word_regexp, pattern_is_literal))
+{
+}
+
+FileScannerHyperscan::FileScannerHyperscan(sync_queue<std::shared_ptr<FileID>> &in_queue,
+		sync_queue<MatchList> &output_queue,
+		std::string regex,
+		bool ignore_case,
+		bool word_regexp,
+		bool pattern_is_literal,
+		std::unique_ptr<hs_database_t> database)
+		: FileScannerPCRE2(in_queue, output_queue, regex, ignore_case, word_regexp, pattern_is_literal, database != nullptr),
+		  m_hs_database(std::move(database))
+{
+	if(m_hs_database)
+	{
+		LOG(INFO) << "Using libhs to find the lines libpcre2 needs to match.";
+		m_use_line_prefilter = true;
+	}
+}
+
+std::unique_ptr<hs_database_t> FileScannerHyperscan::CompileDatabase(std::string regex, bool ignore_case, bool word_regexp,
+		bool pattern_is_literal)
+{
+	// The same tests AnalyzeRegex() will use to decide to bypass libpcre2.
+	std::vector<std::string> alternatives;
+	bool is_whole_regex {false};
+	if(pattern_is_literal || IsPatternLiteral(regex)
+		|| (!word_regexp && GetLiteralAlternatives(regex, &alternatives, &is_whole_regex) && is_whole_regex))
+	{
+		// Our literal matchers will be doing all the work, nothing for libhs to do.
+		LOG(INFO) << "Regex is literal, not using libhs.";
+		return nullptr;
+	}
+
+	// libhs doesn't support (*MARK)s, but since it's only finding candidate lines, it doesn't need the ones
+	// FileScanner::CombinePatterns() uses to tell which pattern matched.
+	regex = StripPatternMarks(std::move(regex));
+
+	if(word_regexp)
+	{
+		// Surround the regex with \b (word boundary) assertions.
+		regex = "\\b(?:" + regex + ")\\b";
+	}
+
+	// We don't need libhs to keep matches on one line, libpcre2 will weed out any lines it finds which only have
+	// a match spanning lines.  Nor do we need it to track the start of the match.
+	unsigned int flags = HS_FLAG_MULTILINE;
+	if(ignore_case)
+	{
+		flags |= HS_FLAG_CASELESS;
+	}
+
+	hs_database_t *database {nullptr};
+	hs_compile_error_t *compile_error {nullptr};
+	if(hs_compile(regex.c_str(), flags, HS_MODE_BLOCK, nullptr, &database, &compile_error) != HS_SUCCESS)
+	{
+		// libhs doesn't support something in the regex, e.g. a backreference or a lookaround.  libpcre2 will have to
+		// do it all.
+		LOG(INFO) << "libhs can't compile regex, using libpcre2 alone: " << compile_error->message;
+		hs_free_compile_error(compile_error);
+		return nullptr;
+	}
+
+	return std::unique_ptr<hs_database_t>(database);
+}
+#else
+		: FileScannerPCRE2(in_queue, output_queue, regex, ignore_case, word_regexp, pattern_is_literal, false)
+{
+}
+#endif
+
+FileScannerHyperscan::~FileScannerHyperscan()
+{
+}
+
+std::string FileScannerHyperscan::GetHyperscanVersion() noexcept
+{
+#if HAVE_LIBHYPERSCAN
+	return hs_version();
+#else
+	return "none";
+#endif
+}
+
+void FileScannerHyperscan::ThreadLocalSetup(int thread_count)
+{
+	FileScannerPCRE2::ThreadLocalSetup(thread_count);
+
+#if HAVE_LIBHYPERSCAN
+	if(!m_use_line_prefilter)
+	{
+		return;
+	}
+
+	for(int i = 0; i<thread_count; ++i)
+	{
+		hs_scratch_t *scratch {nullptr};
+		if(hs_alloc_scratch(m_hs_database.get(), &scratch) != HS_SUCCESS)
+		{
+			throw FileScannerException("libhs couldn't allocate scratch space");
+		}
+		m_hs_scratch.push_back(std::unique_ptr<hs_scratch_t>(scratch));
+	}
+#endif
+}
+
+bool FileScannerHyperscan::FindCandidateLine(int thread_index, const char * __restrict__ file_data, size_t file_size, size_t start_offset,
+		size_t *line_start, size_t *line_end) noexcept
+{
+#if HAVE_LIBHYPERSCAN
+	// Start libhs at the beginning of start_offset's line, so that anchors and word boundaries see the same context
+	// libpcre2 will.
+	std::reverse_iterator<const char*> rstart(file_data + start_offset);
+	std::reverse_iterator<const char*> rend(file_data);
+	size_t scan_start = std::find(rstart, rend, '\n').base() - file_data;
+
+	if(file_size - scan_start <= std::numeric_limits<unsigned int>::max())
+	{
+		hs_first_match fm { start_offset - scan_start, 0 };
+		hs_error_t rc = hs_scan(m_hs_database.get(), file_data + scan_start, file_size - scan_start, 0,
+				m_hs_scratch[thread_index].get(), on_hs_match, &fm);
+
+		if(rc == HS_SUCCESS)
+		{
+			// Scanned everything without a report, there's nothing more to find.
+			return false;
+		}
+		else if(rc == HS_SCAN_TERMINATED)
+		{
+			// Found a match.  Any real match libpcre2 will find ends no earlier than this one, so the line this one
+			// ends on is the first one which can have a real match on it.
+			size_t last_char = scan_start + fm.m_end - 1;
+			std::reverse_iterator<const char*> rlast(file_data + last_char);
+			std::reverse_iterator<const char*> rfirst(file_data + start_offset);
+			*line_start = std::find(rlast, rfirst, '\n').base() - file_data;
+			const char *end = static_cast<const char *>(std::memchr(file_data + last_char, '\n', file_size - last_char));
+			*line_end = (end == nullptr) ? file_size : end - file_data;
+			return true;
+		}
+		// Else libhs had some problem, fall through and let libpcre2 look at everything.
+	}
+#else
+	(void)thread_index;
+	(void)file_data;
+#endif
+
+	*line_start = start_offset;
+	*line_end = file_size;
+	return start_offset < file_size;
+}
@@ -0,0 +1,120 @@
+/*
+ * Copyright 2022 Gary R. Van Sickle (grvs@users.sourceforge.net).
+ *
+ * This file is part of UniversalCodeGrep.
+ *
+ * UniversalCodeGrep is free software: you can redistribute it and/or modify it under the
+ * terms of version 3 of the GNU General Public License as published by the Free
+ * Software Foundation.
+ *
+ * UniversalCodeGrep is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * UniversalCodeGrep.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file FileScannerHyperscan.h */
+
+#ifndef SRC_FILESCANNERHYPERSCAN_H_
+#define SRC_FILESCANNERHYPERSCAN_H_
+
+#include <config.h>
+
+#include "FileScannerPCRE2.h"
+
+#include <memory>
+#include <vector>
+
+#if HAVE_LIBHYPERSCAN
+#include <hs.h>
+#endif
+
+#if HAVE_LIBHYPERSCAN
+/// @name Custom deleters for the libhs objects we'll be using.
+/// These are implemented as specializations of the std::default_delete<> template.
+/// @{
+namespace std
+{
+
+	template<>
+	struct default_delete<hs_database_t>
+	{
+		void operator()(hs_database_t *ptr)
+		{ hs_free_database(ptr); };
+	};
+
+	template<>
+	struct default_delete<hs_scratch_t>
+	{
+		void operator()(hs_scratch_t *ptr)
+		{ hs_free_scratch(ptr); };
+	};
+
+}
+/// @}
+#endif  // HAVE_LIBHYPERSCAN
+
+/**
+ * FileScanner which uses libhs (Hyperscan, or its portable fork Vectorscan) to find the lines which might match,
+ * and libpcre2 to find the actual matches on them.
+ *
+ * libhs's SIMD automata are much faster than a backtracking matcher at ruling out text, but it reports every match
+ * end rather than PCRE's leftmost-first matches, and doesn't support backreferences, lookaround, or patterns which
+ * can match the empty string.  So it's only used as a line filter, and if it can't compile the regex, this class
+ * behaves exactly like FileScannerPCRE2.
+ */
+class FileScannerHyperscan: public FileScannerPCRE2
+{
+public:
+	FileScannerHyperscan(sync_queue<std::shared_ptr<FileID>> &in_queue,
+			sync_queue<MatchList> &output_queue,
+			std::string regex,
+			bool ignore_case,
+			bool word_regexp,
+			bool pattern_is_literal);
+	~FileScannerHyperscan() override;
+
+	/**
+	 * Returns the version string of the libhs library.
+	 * @return
+	 */
+	static std::string GetHyperscanVersion() noexcept;
+
+	void ThreadLocalSetup(int thread_count) final;
+
+private:
+
+#if HAVE_LIBHYPERSCAN
+	/// The constructor proper, once CompileDatabase() has decided whether libpcre2 needs PCRE2_USE_OFFSET_LIMIT.
+	FileScannerHyperscan(sync_queue<std::shared_ptr<FileID>> &in_queue,
+			sync_queue<MatchList> &output_queue,
+			std::string regex,
+			bool ignore_case,
+			bool word_regexp,
+			bool pattern_is_literal,
+			std::unique_ptr<hs_database_t> database);
+
+	/**
+	 * Compile @a regex into a libhs database for finding candidate lines.
+	 *
+	 * @returns  The database, or nullptr if libhs can't compile the regex or our literal matchers won't need libpcre2.
+	 */
+	static std::unique_ptr<hs_database_t> CompileDatabase(std::string regex, bool ignore_case, bool word_regexp,
+			bool pattern_is_literal);
+#endif
+
+	bool FindCandidateLine(int thread_index, const char * __restrict__ file_data, size_t file_size, size_t start_offset,
+			size_t *line_start, size_t *line_end) noexcept final;
+
+#if HAVE_LIBHYPERSCAN
+	/// The compiled libhs database.
+	std::unique_ptr<hs_database_t> m_hs_database;
+
+	/// Per-thread libhs scratch space, indexed by thread_index.
+	std::vector<std::unique_ptr<hs_scratch_t>> m_hs_scratch;
+#endif
+};
+
+#endif /* SRC_FILESCANNERHYPERSCAN_H_ */
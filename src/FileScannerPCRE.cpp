@@ -146,7 +146,6 @@ void FileScannerPCRE::ScanFile(int thread_index, const char* __restrict__ file_d
 	// Match output vector.  We won't support submatches, so we only need two entries, plus a third for pcre's own use.
 	int ovector[3] = {-1, 0, 0};
 	size_t line_no = 1;
-	size_t prev_lineno = 0;
 	const char *prev_lineno_search_end = file_data;
 	// Up-cast file_size, which is a size_t (unsigned) to a ptrdiff_t (signed) which should be able to handle the
 	// same positive range, and not cause issues when compared with the ints of ovector[].
@@ -253,18 +252,31 @@ void FileScannerPCRE::ScanFile(int thread_index, const char* __restrict__ file_d
 			return;
 		}
 
+		if(m_first_match_only)
+		{
+			// All we need to know is that there's a match.
+			ml.SetFileMatched();
+			break;
+		}
+
 		// There was a match.  Package it up in the MatchList which was passed in.
 		line_no += CountLinesSinceLastMatch(prev_lineno_search_end, file_data+ovector[0]);
 		prev_lineno_search_end = file_data+ovector[0];
-		if(line_no == prev_lineno)
-		{
-			// Skip multiple matches on one line.
-			continue;
-		}
-		prev_lineno = line_no;
 		Match m(file_data, file_size, ovector[0], ovector[1], line_no);
 
 		ml.AddMatch(std::move(m));
+
+		// Don't look for any more matches on this line, resume at the start of the next one.  The last character of a
+		// non-empty match is still on the match's line, even if it's the newline.
+		int last_char = (ovector[1] > ovector[0]) ? ovector[1]-1 : ovector[0];
+		const char *line_end = static_cast<const char *>(std::memchr(file_data+last_char, '\n', file_size-last_char));
+		if(line_end == nullptr || line_end+1 == file_data+file_size)
+		{
+			// That was the last line.
+			break;
+		}
+		ovector[0] = line_end - file_data;
+		ovector[1] = ovector[0] + 1;
 	}
 #endif // HAVE_LIBPCRE
 }
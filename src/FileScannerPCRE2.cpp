@@ -28,6 +28,11 @@
 #include <iostream>
 #include <libext/Logger.h>
 #include <cstring>
+#include <cstdlib>
+#include <cctype>
+#include <vector>
+#include <algorithm>
+#include <iterator>
 
 #include <libext/hints.hpp>
 #include <libext/memory.hpp>
@@ -39,7 +44,8 @@
  * is to prevent a regex like 'abc\s+def' from matching across an eol boundary, since '\s' matches both
  * 'normal' spaces and also newlines.
  *
- * It works in conjunction with a wrapper the constructor puts around the incoming regex, "(?:" + regex + ")(?=.*?$)(?C1)".
+ * It works in conjunction with a wrapper the constructor puts around the incoming regex, "(?:" + regex + ")(?=.*?$)(?C1)",
+ * but only if rewrite_for_single_line_matches() below can't keep the regex from matching newlines in the first place.
  * What happens is that when PCRE2 finds a potential match of the given regex, the (?C1) causes this function to be called.
  * This function then scans the potential match for a '\n' character.  If it finds one, the potential match is rejected by returning
  * a positive integer (+1), and if it's able to, PCRE2 backtracks and looks for a different match solution.  If no
@@ -54,20 +60,26 @@ static int callout_handler(pcre2_callout_block *cob, void *ctx)
 	(void)ctx;
 	const char * p = (const char *)std::memchr(cob->subject+cob->start_match, '\n', cob->current_position - cob->start_match);
 
-	std::string cur_match_str((const char *)cob->subject+cob->start_match, (const char *)cob->subject + cob->current_position);
-
 	if(p == nullptr)
 	{
-		//std::cerr << "CALLOUT: No eols yet, string is: \"" << cur_match_str << "\"\n";
 		return 0;
 	}
 	else
 	{
-		//std::cerr << "CALLOUT: Found eol, string is: \"" << cur_match_str << "\"\n";
 		return 1;
 	}
 }
 
+/**
+ * Returns true if @a rc is the pcre2_match() error for having run into one of the limits on how much work a match
+ * attempt may do, as opposed to a problem with the regex or subject.
+ */
+static bool is_match_limit_error(int rc) noexcept
+{
+	return rc == PCRE2_ERROR_MATCHLIMIT || rc == PCRE2_ERROR_DEPTHLIMIT || rc == PCRE2_ERROR_HEAPLIMIT
+			|| rc == PCRE2_ERROR_JIT_STACKLIMIT;
+}
+
 static int count_callouts_callback(pcre2_callout_enumerate_block *ceb [[maybe_unused]], void *ctx)
 {
 	size_t * ctr { reinterpret_cast<size_t*>(ctx) };
@@ -91,6 +103,354 @@ static size_t pattern_num_callouts(const pcre2_code *code)
 	return num_callouts;
 }
 
+/**
+ * Returns @a regex quoted for an error message, cut short if it's too long to be of any help there, e.g. from
+ * a long -f file combined into one regex.
+ */
+static std::string abbreviate_regex(const std::string &regex)
+{
+	constexpr size_t max_len = 64;
+
+	if(regex.size() <= max_len)
+	{
+		return "\"" + regex + "\"";
+	}
+
+	return "\"" + regex.substr(0, max_len) + "...\" (" + std::to_string(regex.size()) + " chars)";
+}
+
+/**
+ * Returns the index of the ']' which closes the character class starting at regex[i], or std::string::npos if it's
+ * unterminated or has a \Q...\E in it.  Sets @a may_match_newline if the class is positive and has anything
+ * in it which could match a '\n'.
+ */
+static size_t find_class_end(const std::string &regex, size_t i, bool *may_match_newline) noexcept
+{
+	*may_match_newline = false;
+	bool negated = false;
+
+	++i;
+	if(i < regex.size() && regex[i] == '^')
+	{
+		negated = true;
+		++i;
+	}
+	if(i < regex.size() && regex[i] == ']')
+	{
+		// A ']' first is a literal.
+		++i;
+	}
+	for(; i < regex.size() && regex[i] != ']'; ++i)
+	{
+		unsigned char c = regex[i];
+		if(c == '\\')
+		{
+			if(i+1 == regex.size() || regex[i+1] == 'Q')
+			{
+				return std::string::npos;
+			}
+			c = regex[++i];
+			// Anything but escaped punctuation and escapes we know can't match a newline might.
+			if(!std::ispunct(c) && std::strchr("wdShVtrfeab", c) == nullptr)
+			{
+				*may_match_newline = true;
+			}
+			else if(i+2 < regex.size() && regex[i+1] == '-' && regex[i+2] != ']')
+			{
+				// The start of a range, e.g. '[\t- ]', which includes '\n' if it starts at or below it.
+				static const char escape_chars[] = "trfeab";
+				static const unsigned char escape_values[] = { '\t', '\r', '\f', 0x1B, 0x07, 0x08 };
+				const char *e = std::ispunct(c) ? nullptr : std::strchr(escape_chars, c);
+				unsigned char value = std::ispunct(c) ? c : (e != nullptr ? escape_values[e - escape_chars] : 0);
+				if(value <= '\n')
+				{
+					*may_match_newline = true;
+				}
+			}
+		}
+		else if(c == '[' && i+1 < regex.size() && std::strchr(":=.", regex[i+1]) != nullptr)
+		{
+			// POSIX class, e.g. '[:alpha:]'.  Of these only [:space:], [:cntrl:], [:ascii:], and negated ones include '\n'.
+			auto end = regex.find(std::string(1, regex[i+1]) + "]", i+2);
+			if(end == std::string::npos)
+			{
+				return end;
+			}
+			std::string name = regex.substr(i+2, end-(i+2));
+			if(name.empty() || name[0] == '^' || name == "space" || name == "cntrl" || name == "ascii")
+			{
+				*may_match_newline = true;
+			}
+			i = end+1;
+		}
+		else if(c <= '\n')
+		{
+			// A '\n', or the start of a range which could include it.
+			*may_match_newline = true;
+		}
+	}
+
+	if(negated)
+	{
+		// Negated classes are dealt with by adding a '\n' to them.
+		*may_match_newline = false;
+	}
+
+	return (i < regex.size()) ? i : std::string::npos;
+}
+
+/**
+ * Rewrites @a regex so that nothing it matches can contain a newline, which is otherwise what the callout above is for.
+ * Escapes and classes which could match a '\n' are replaced with ones which don't, e.g. '\s' becomes '[^\S\n]' and
+ * '[^a]' becomes '[^a\n]'.  Lookaround assertions are left alone, since they can look past the end of the line without
+ * the match itself crossing it.
+ *
+ * @returns  false if @a regex has anything in it we don't know how to keep off of newlines (e.g. '\n' itself, '(?s)',
+ *           backreferences, or recursion), in which case the callout is still needed.
+ */
+static bool rewrite_for_single_line_matches(const std::string &regex, std::string *out)
+{
+	out->clear();
+	out->reserve(regex.size()*2);
+
+	// For each currently open group, whether it's a lookaround assertion.
+	std::vector<bool> open_groups;
+	size_t lookaround_depth = 0;
+
+	for(size_t i = 0; i < regex.size(); )
+	{
+		const char c = regex[i];
+		const bool in_lookaround = (lookaround_depth > 0);
+
+		if(c == '\\')
+		{
+			if(i+1 == regex.size())
+			{
+				return false;
+			}
+			const char e = regex[i+1];
+			if(e == 'Q')
+			{
+				// Quoted literal text.  Copy it through the \E.
+				auto end = regex.find("\\E", i+2);
+				end = (end == std::string::npos) ? regex.size() : end+2;
+				if(!in_lookaround && regex.find('\n', i) < end)
+				{
+					return false;
+				}
+				out->append(regex, i, end-i);
+				i = end;
+				continue;
+			}
+			if(in_lookaround || std::ispunct(static_cast<unsigned char>(e)))
+			{
+				out->append(regex, i, 2);
+				i += 2;
+				continue;
+			}
+			switch(e)
+			{
+			case 's':
+				*out += "[^\\S\\n]";
+				break;
+			case 'v':
+				*out += "[^\\V\\n]";
+				break;
+			case 'W':
+				*out += "[^\\w\\n]";
+				break;
+			case 'D':
+				*out += "[^\\d\\n]";
+				break;
+			case 'H':
+				*out += "[^\\h\\n]";
+				break;
+			case 'R':
+				// \R would match all of a "\r\n", so it can't match at a '\r' which is followed by one.
+				*out += "(?:\\r(?!\\n)|[^\\V\\r\\n])";
+				break;
+			case 'p':
+			case 'P':
+			{
+				// Unicode property, '\pL' or '\p{...}'.
+				size_t end = i+3;
+				if(i+2 < regex.size() && regex[i+2] == '{')
+				{
+					end = regex.find('}', i+2);
+					if(end == std::string::npos)
+					{
+						return false;
+					}
+					++end;
+				}
+				*out += "(?:(?!\\n)";
+				out->append(regex, i, end-i);
+				*out += ")";
+				i = end;
+				continue;
+			}
+			case 'x':
+			{
+				// Hex char code, '\xhh' or '\x{hhh}'.
+				size_t start = i+2, end = i+2;
+				if(start < regex.size() && regex[start] == '{')
+				{
+					++start;
+					end = regex.find('}', start);
+					if(end == std::string::npos)
+					{
+						return false;
+					}
+				}
+				else
+				{
+					while(end < regex.size() && end < i+4 && std::isxdigit(static_cast<unsigned char>(regex[end])))
+					{
+						++end;
+					}
+				}
+				std::string hex = regex.substr(start, end-start);
+				if(hex.size() > 8 || hex.find_first_not_of("0123456789abcdefABCDEF") != std::string::npos)
+				{
+					return false;
+				}
+				if(!hex.empty() && std::stoul(hex, nullptr, 16) == '\n')
+				{
+					return false;
+				}
+				end = (regex[i+2] == '{') ? end+1 : end;
+				out->append(regex, i, end-i);
+				i = end;
+				continue;
+			}
+			default:
+				if(std::strchr("ncoXCgk0123456789", e) != nullptr)
+				{
+					// Newlines, other ways of writing char codes, whole grapheme clusters, and backreferences.
+					return false;
+				}
+				// Everything else (e.g. '\w', '\b', '\t') can't match a newline.
+				out->append(regex, i, 2);
+				break;
+			}
+			i += 2;
+		}
+		else if(c == '[')
+		{
+			bool may_match_newline;
+			auto end = find_class_end(regex, i, &may_match_newline);
+			if(end == std::string::npos)
+			{
+				return false;
+			}
+			if(in_lookaround)
+			{
+				out->append(regex, i, end+1-i);
+			}
+			else if(regex[i+1] == '^')
+			{
+				out->append(regex, i, end-i);
+				*out += "\\n]";
+			}
+			else if(may_match_newline)
+			{
+				*out += "(?:(?!\\n)";
+				out->append(regex, i, end+1-i);
+				*out += ")";
+			}
+			else
+			{
+				out->append(regex, i, end+1-i);
+			}
+			i = end+1;
+		}
+		else if(c == '(')
+		{
+			if(regex.compare(i, 3, "(?#") == 0)
+			{
+				// Comment.
+				auto end = regex.find(')', i);
+				if(end == std::string::npos)
+				{
+					return false;
+				}
+				out->append(regex, i, end+1-i);
+				i = end+1;
+				continue;
+			}
+			if(regex.compare(i, 7, "(*MARK:") == 0 || regex.compare(i, 3, "(*:") == 0)
+			{
+				// A mark, e.g. from FileScanner::CombinePatterns().  Doesn't match anything.
+				auto end = regex.find(')', i);
+				if(end == std::string::npos)
+				{
+					return false;
+				}
+				out->append(regex, i, end+1-i);
+				i = end+1;
+				continue;
+			}
+			if(regex.compare(i, 2, "(*") == 0 || regex.compare(i, 3, "(?(") == 0 || regex.compare(i, 3, "(?R") == 0
+				|| regex.compare(i, 3, "(?&") == 0 || regex.compare(i, 4, "(?P>") == 0 || regex.compare(i, 4, "(?P=") == 0
+				|| regex.compare(i, 3, "(?C") == 0
+				|| (regex.compare(i, 2, "(?") == 0 && regex.find_first_of("0123456789", i+2) == regex.find_first_not_of("+-", i+2)))
+			{
+				// Verbs, conditionals, recursion, subroutine calls, and callouts.
+				return false;
+			}
+
+			bool is_lookaround = regex.compare(i, 3, "(?=") == 0 || regex.compare(i, 3, "(?!") == 0
+					|| regex.compare(i, 4, "(?<=") == 0 || regex.compare(i, 4, "(?<!") == 0;
+
+			if(!is_lookaround && i+2 < regex.size() && regex[i+1] == '?')
+			{
+				// Inline options, e.g. '(?i)' or '(?i:...)'.  '(?s)' makes '.' match newlines, and '(?x)' changes how the
+				// rest of the regex is parsed.
+				auto end = regex.find_first_not_of("imnsxUJ-^", i+2);
+				if(end != std::string::npos && (regex[end] == ')' || regex[end] == ':')
+					&& regex.find_first_of("sx", i+2) < end)
+				{
+					return false;
+				}
+				if(end != std::string::npos && regex[end] == ')' && end > i+2)
+				{
+					// Option setting, not a group.
+					out->append(regex, i, end+1-i);
+					i = end+1;
+					continue;
+				}
+			}
+
+			open_groups.push_back(is_lookaround);
+			lookaround_depth += is_lookaround;
+			*out += c;
+			++i;
+		}
+		else if(c == ')')
+		{
+			if(open_groups.empty())
+			{
+				return false;
+			}
+			lookaround_depth -= open_groups.back();
+			open_groups.pop_back();
+			*out += c;
+			++i;
+		}
+		else if(c == '\n' && !in_lookaround)
+		{
+			return false;
+		}
+		else
+		{
+			*out += c;
+			++i;
+		}
+	}
+
+	return open_groups.empty();
+}
+
 #endif  // HAVE_LIBPCRE2
 
 FileScannerPCRE2::FileScannerPCRE2(sync_queue<std::shared_ptr<FileID>> &in_queue,
@@ -98,7 +458,8 @@ FileScannerPCRE2::FileScannerPCRE2(sync_queue<std::shared_ptr<FileID>> &in_queue
 		std::string regex,
 		bool ignore_case,
 		bool word_regexp,
-		bool pattern_is_literal) : FileScanner(in_queue, output_queue, regex, ignore_case, word_regexp, pattern_is_literal)
+		bool pattern_is_literal,
+		bool use_offset_limit) : FileScanner(in_queue, output_queue, regex, ignore_case, word_regexp, pattern_is_literal)
 {
 #if HAVE_LIBPCRE2
 	// Compile the regex.
@@ -125,23 +486,44 @@ FileScannerPCRE2::FileScannerPCRE2(sync_queue<std::shared_ptr<FileID>> &in_queue
 		regex = "\\Q" + regex + "\\E";
 	}
 
-	if(m_word_regexp)
+	std::string indent;
+	bool indent_required {false};
+	if(use_offset_limit || (!m_pattern_is_literal && (GetRequiredLiteral(original_pattern).size() > 1
+			|| !GetLineStartLiteral(original_pattern, &indent, &indent_required).empty())))
 	{
-		// Surround the regex with \b (word boundary) assertions.
-		regex = "\\b(?:" + regex + ")\\b";
+		// A derived class or AnalyzeRegex() may decide to only hand libpcre2 the lines which might match, which
+		// needs to be known at compile time.
+		regex_compile_options |= PCRE2_USE_OFFSET_LIMIT;
 	}
 
-	// Put in our callout, which essentially exists to make '\s' not match a newline.
-	regex = "(?:" + regex + ")(?=.*?$)(?C1)";
+	m_regex_compile_options = regex_compile_options;
+	std::string unmarked_regex = StripPatternMarks(regex);
+	bool has_marks = (unmarked_regex.size() != regex.size());
 
-	// Compile the regex.
-	m_pcre2_regex = pcre2_compile(reinterpret_cast<PCRE2_SPTR8>(regex.c_str()), regex.length(), regex_compile_options, &error_code, &error_offset, NULL);
+	m_pcre2_regex = CompileSingleLineRegex(&regex, regex_compile_options, &error_code, &error_offset);
+
+	std::vector<std::string> alternatives;
+	bool is_whole_regex {false};
+	if (m_pcre2_regex == NULL && !m_word_regexp && !m_pattern_is_literal
+			&& GetLiteralAlternatives(original_pattern, &alternatives, &is_whole_regex) && is_whole_regex)
+	{
+		// Most likely too many literals for libpcre2, e.g. from a long -f file.  If the multi-literal search can
+		// do all the matching by itself, we don't need libpcre2 at all.
+		LOG(INFO) << "libpcre2 can't compile the alternation of literals: " << PCRE2ErrorCodeToErrorString(error_code);
+		AnalyzeRegex(original_pattern);
+		if(!m_use_multi_literal)
+		{
+			throw FileScannerException(std::string("Compilation of regex ") + abbreviate_regex(regex) + " failed at offset "
+					+ std::to_string(error_offset) + ": " + PCRE2ErrorCodeToErrorString(error_code));
+		}
+		return;
+	}
 
 	if (m_pcre2_regex == NULL)
 	{
 		// Regex compile failed, we can't continue.
-		throw FileScannerException(std::string("Compilation of regex \"") + regex + "\" failed at offset " + std::to_string(error_offset) + ": "
-				+ PCRE2ErrorCodeToErrorString(error_code));
+		throw FileScannerException(std::string("Compilation of regex ") + abbreviate_regex(regex) + " failed at offset "
+				+ std::to_string(error_offset) + ": " + PCRE2ErrorCodeToErrorString(error_code));
 	}
 
 	int jit_retval = pcre2_jit_compile(m_pcre2_regex, PCRE2_JIT_COMPLETE);
@@ -169,14 +551,61 @@ FileScannerPCRE2::FileScannerPCRE2(sync_queue<std::shared_ptr<FileID>> &in_queue
 		throw FileScannerException(std::string("Callouts not supported."));
 	}
 
+	if(has_marks)
+	{
+		// FileScanner::CombinePatterns() marked which pattern matched, which pcre2_dfa_match() doesn't support.
+		// Give it a copy without the marks.
+		m_pcre2_dfa_regex.reset(CompileSingleLineRegex(&unmarked_regex, regex_compile_options, &error_code, &error_offset));
+	}
+
 	// Do our own analysis and see if there's anything we can do to help speed up the matching.
 	AnalyzeRegex(original_pattern);
+#else
+	(void)use_offset_limit;
 #endif
 }
 
+#if HAVE_LIBPCRE2
+pcre2_code* FileScannerPCRE2::CompileSingleLineRegex(std::string *regex, uint32_t compile_options, int *error_code, PCRE2_SIZE *error_offset) const
+{
+	if(m_word_regexp)
+	{
+		// Surround the regex with \b (word boundary) assertions.
+		*regex = "\\b(?:" + *regex + ")\\b";
+	}
+
+	// Matches can't span lines.  If we can, rewrite the regex so nothing in it can match a newline.
+	std::string single_line_regex;
+	pcre2_code *code = nullptr;
+	if(rewrite_for_single_line_matches(*regex, &single_line_regex))
+	{
+		LOG(INFO) << "Regex rewritten for single-line matching as '" << single_line_regex << "'.";
+		code = pcre2_compile(reinterpret_cast<PCRE2_SPTR8>(single_line_regex.c_str()), single_line_regex.length(),
+				compile_options, error_code, error_offset, NULL);
+	}
+
+	if(code == nullptr)
+	{
+		// Couldn't rewrite it, or the rewrite didn't compile.  Put in our callout, which rejects any match containing a
+		// newline.  This costs a call out of the matcher for every candidate match, so is the last resort.
+		LOG(INFO) << "Using callout for single-line matching.";
+		*regex = "(?:" + *regex + ")(?=.*?$)(?C1)";
+
+		// Compile the regex.
+		code = pcre2_compile(reinterpret_cast<PCRE2_SPTR8>(regex->c_str()), regex->length(), compile_options, error_code, error_offset, NULL);
+	}
+
+	return code;
+}
+#endif
+
 FileScannerPCRE2::~FileScannerPCRE2()
 {
 #if HAVE_LIBPCRE2
+	LOG(INFO) << "Match limit fallback stats:"
+		<< "\nNumber of files which hit the match limit or match time limit: " << m_num_files_limited
+		<< "\nNumber of lines matched with pcre2_dfa_match(): " << m_num_lines_dfa_matched
+		<< "\nNumber of lines skipped after hitting the limits with both matchers: " << m_num_lines_skipped;
 	pcre2_code_free(m_pcre2_regex);
 #endif
 }
@@ -200,6 +629,7 @@ void FileScannerPCRE2::AnalyzeRegex(const std::string &regex_passed_in) noexcept
 	(void)regex_passed_in;
 #else
 	// Check for a static first code unit or units.
+	bool at_line_start {false};
 
 	// Check for a first code unit bitmap.
 	const uint8_t *first_bitmap {nullptr};
@@ -208,19 +638,10 @@ void FileScannerPCRE2::AnalyzeRegex(const std::string &regex_passed_in) noexcept
 	{
 		ConstructCodeUnitTable(first_bitmap);
 		LOG(INFO) << "First code unit of pattern is one of '" << std::string((const char*)m_compiled_cu_bitmap, m_end_fpcu_table) << "'.";
-		ConstructRangePairTable();
 
-		// Decide whether to use the code unit table or the pair table.
-		if((m_end_fpcu_table > 0) && (m_end_fpcu_table < m_end_ranges_table))
-		{
-			// Individual code unit table is shorter, which means fewer compares.  Use it.
-			m_use_first_code_unit_table = true;
-		}
-		else if(m_end_ranges_table > 0)
-		{
-			// Pair table is shorter, use it.
-			m_use_range_pair_table = true;
-		}
+		// find_first_of() classifies bytes with the nibble tables, which costs the same for any size of set.  Only a
+		// set of every code unit is no help.
+		m_use_first_code_unit_table = (m_end_fpcu_table > 0) && (m_end_fpcu_table < 256);
 	}
 	else
 	{
@@ -240,43 +661,121 @@ void FileScannerPCRE2::AnalyzeRegex(const std::string &regex_passed_in) noexcept
 		}
 		else if(first_code_type == 2)
 		{
-			// The "first code unit" is the start of any line.
-			/// @todo Not sure we can make good use of this.
+			// The "first code unit" is the start of any line, so no match can start anywhere else.
+			at_line_start = true;
 		}
 	}
 
-	constexpr auto vec_size_bytes = 16;
+	// Caseless literals are matched against a lowercased copy of the literal, folding the haystack as we go.
+	const char * const case_str = m_ignore_case ? "caseless" : "caseful";
 
-	if(!m_ignore_case  // If we're not ignoring case (smart case set this in ArgParse, @todo probably should move)...
-			&& !m_word_regexp)  // ... and we aren't doing a --word-regexp...
+	// If we have a static first code unit, let's check and see if the string is not a regex but a literal.
+	auto pat_is_lit = IsPatternLiteral(regex_passed_in);
+	if(m_pattern_is_literal || pat_is_lit)  // If we've been told to treat the pattern as literal, or it actually is literal
 	{
-		// If we have a static first code unit, let's check and see if the string is not a regex but a literal.
-		auto pat_is_lit = IsPatternLiteral(regex_passed_in);
-		if(m_pattern_is_literal || pat_is_lit)  // If we've been told to treat the pattern as literal, or it actually is literal
+		// This is a simple string comparison, we can bypass libpcre2 entirely.  For --word-regexp, we check
+		// the word boundaries around each hit ourselves.
+		LOG(INFO) << "Using " << case_str << " literal search optimization" << (m_word_regexp ? " with word boundary checks" : "");
+		SetLiteralSearchString(regex_passed_in.c_str(), regex_passed_in.size());
+		m_use_literal = true;
+	}
+	else if(std::vector<std::string> alternatives; GetLiteralAlternatives(regex_passed_in, &alternatives, &m_use_multi_literal))
+	{
+		// It's an alternation of literals, or starts with one.  Search for all of them at once instead of
+		// having libpcre2 try each alternative at every possible starting position.
+		uint8_t first_cu_bitmap[32] {0};
+		for(const auto & alt : alternatives)
 		{
-			// This is a simple string comparison, we can bypass libpcre2 entirely.
-			LOG(INFO) << "Using caseful literal search optimization";
-			m_literal_search_string_len = regex_passed_in.size();
-			size_t size_to_alloc = m_literal_search_string_len+1;
-			m_literal_search_string.reset(static_cast<uint8_t*>(overaligned_alloc(vec_size_bytes, size_to_alloc)));
-			std::memcpy(static_cast<void*>(m_literal_search_string.get()), static_cast<const void*>(regex_passed_in.c_str()), size_to_alloc);
-			m_use_literal = true;
+			uint8_t c = static_cast<uint8_t>(m_ignore_case ? ascii_tolower(alt[0]) : alt[0]);
+			first_cu_bitmap[c/8] |= 0x01 << (c%8);
+			if(m_ignore_case && c >= 'a' && c <= 'z')
+			{
+				// Either case of the letter can start a match.
+				c &= ~0x20;
+				first_cu_bitmap[c/8] |= 0x01 << (c%8);
+			}
 		}
-		else if(m_use_first_code_unit_table)
+
+		bool build_dfa = (alternatives.size() > f_max_first_cu_scan_literals);
+		m_multi_literal = std::make_unique<MultiLiteralMatcher>(std::move(alternatives), build_dfa, m_ignore_case);
+
+		if(build_dfa && m_multi_literal->GetNumDFAStates() == 0)
+		{
+			// Too many literals for the DFA, and checking them all at each first char hit would be slower than
+			// libpcre2.  Let it do the matching.  The matcher is still good for GetPatternNumber().
+			LOG(INFO) << "Too many literals for the multi-literal search, libpcre2 will match them.";
+			m_use_multi_literal = false;
+		}
+		else
+		{
+			if(m_word_regexp)
+			{
+				// The first alternative at a position may not be the one with word boundaries around it, e.g. 'foo|foobar'
+				// in "foobar".  Let libpcre2 sort that out.
+				m_use_multi_literal = false;
+			}
+			LOG(INFO) << "Using " << case_str << " multi-literal " << (m_use_multi_literal ? "search" : "prefix") << " optimization of "
+					<< m_multi_literal->size() << " literals";
+			m_use_multi_lit_prefix = !m_use_multi_literal;
+
+			// The literals' first chars are our first possible code units.
+			ConstructCodeUnitTable(first_cu_bitmap);
+		}
+	}
+	else
+	{
+		size_t lit_prefix_len = 0;
+		if(m_use_first_code_unit_table)
 		{
 			// It's not a literal, but it does have at least one literal at the beginning.  Maybe there are more literals.
 			// Analyze the regex and see if we can't extend this single code unit into a longer literal prefix.
-			auto lit_prefix_len = GetLiteralPrefixLen(regex_passed_in);
+			// (Ignoring case, the first code unit is both cases of a letter.)
+			lit_prefix_len = GetLiteralPrefixLen(regex_passed_in);
+		}
+
+		// There may be a longer literal somewhere further in, e.g. '\w+_handler\('.
+		std::string required_literal = m_pattern_is_literal ? "" : GetRequiredLiteral(regex_passed_in);
 
-			if(lit_prefix_len > 1)
+		// If every match starts a line, there may be a literal right after the '^' and any indentation, e.g. '#include'
+		// in '^\s*#include'.
+		std::string indent;
+		bool indent_required {false};
+		std::string line_start_literal = (at_line_start && !m_pattern_is_literal) ?
+				GetLineStartLiteral(regex_passed_in, &indent, &indent_required) : "";
+
+		if(lit_prefix_len > 1 && lit_prefix_len >= required_literal.size())
+		{
+			LOG(INFO) << "Using " << case_str << " literal prefix optimization of '" << regex_passed_in.substr(0, lit_prefix_len) << "'";
+			SetLiteralSearchString(regex_passed_in.c_str(), lit_prefix_len);
+			m_use_lit_prefix = true;
+		}
+		else if(!line_start_literal.empty() && line_start_literal.size() >= required_literal.size()
+				&& (indent.empty() || line_start_literal.size() > 1 || !std::isalnum(static_cast<unsigned char>(line_start_literal[0]))))
+		{
+			// Checking for the literal only where it can be, at the start of each line, rules out the lines which have
+			// it anywhere else too.  After indentation though we can only search for the literal itself, and a single
+			// letter or digit is everywhere in code; libpcre2's own line start search does better on those.
+			LOG(INFO) << "Using " << case_str << " line start literal optimization of '" << line_start_literal << "'"
+					<< (indent.empty() ? "" : " after any indentation");
+			if(indent.empty())
 			{
-				LOG(INFO) << "Using caseful literal prefix optimization of '" << regex_passed_in.substr(0, lit_prefix_len) << "'";
-				m_literal_search_string_len = lit_prefix_len;
-				size_t size_to_alloc = m_literal_search_string_len+1;
-				m_literal_search_string.reset(static_cast<uint8_t*>(overaligned_alloc(vec_size_bytes, size_to_alloc)));
-						std::memcpy(static_cast<void*>(m_literal_search_string.get()), static_cast<const void*>(regex_passed_in.c_str()), size_to_alloc);
-				m_use_lit_prefix = true;
+				// FindLineStartLiteral() searches for the newline before the literal too.
+				line_start_literal.insert(0, 1, '\n');
 			}
+			SetLiteralSearchString(line_start_literal.c_str(), line_start_literal.size());
+			for(auto c : indent)
+			{
+				m_line_start_indent[static_cast<uint8_t>(c)] = true;
+			}
+			m_line_start_indent_required = indent_required;
+			m_use_line_start_literal = true;
+		}
+		else if(required_literal.size() > 1)
+		{
+			// The constructor compiled the regex with PCRE2_USE_OFFSET_LIMIT for this.
+			LOG(INFO) << "Using " << case_str << " required literal optimization of '" << required_literal << "'";
+			SetLiteralSearchString(required_literal.c_str(), required_literal.size());
+			m_use_inner_literal = true;
 		}
 	}
 
@@ -291,17 +790,171 @@ void FileScannerPCRE2::ThreadLocalSetup(int thread_count)
 	{
 #if HAVE_LIBPCRE2
 		/// Create a std::unique_ptr<> with a custom deleter (see above) to manage the lifetime of the match data.
-		m_match_data.push_back(std::unique_ptr<pcre2_match_data>(pcre2_match_data_create_from_pattern(m_pcre2_regex, NULL)));
+		// Without a compiled regex, the multi-literal search is doing all the matching, and only needs the one ovector pair.
+		m_match_data.push_back(std::unique_ptr<pcre2_match_data>(m_pcre2_regex != nullptr ?
+				pcre2_match_data_create_from_pattern(m_pcre2_regex, NULL) : pcre2_match_data_create(1, NULL)));
 		m_match_context.push_back(std::unique_ptr<pcre2_match_context>(pcre2_match_context_create(NULL)));
 		// Hook in our callout function.
 		pcre2_set_callout(m_match_context[i].get(), callout_handler, this);
+		if(m_match_limit != 0)
+		{
+			pcre2_set_match_limit(m_match_context[i].get(), m_match_limit);
+		}
 #endif  // HAVE_LIBPCRE2
 	}
+
+	// Any derived class has finished setting up its own prefilters by now.
+	SelectScanStrategy();
+}
+
+bool FileScannerPCRE2::FindCandidateLine(int thread_index, const char * __restrict__ file_data, size_t file_size, size_t start_offset,
+		size_t *line_start, size_t *line_end) noexcept
+{
+	(void)thread_index;
+	(void)file_data;
+
+	// We have no way to rule out any lines, so every line is a candidate.
+	*line_start = start_offset;
+	*line_end = file_size;
+	return start_offset < file_size;
+}
+
+void FileScannerPCRE2::SelectScanStrategy() noexcept
+{
+	// In the same order of precedence the prefilters had when ScanFile() chose among them for every match.
+	if(m_use_multi_literal)
+	{
+		m_scan_file = &FileScannerPCRE2::ScanFileWith<ScanStrategy::MULTI_LITERAL>;
+	}
+	else if(m_use_literal && m_word_regexp)
+	{
+		m_scan_file = &FileScannerPCRE2::ScanFileWith<ScanStrategy::LITERAL_WORD>;
+	}
+	else if(m_use_literal)
+	{
+		m_scan_file = &FileScannerPCRE2::ScanFileWith<ScanStrategy::LITERAL>;
+	}
+	else if(m_use_line_prefilter)
+	{
+		m_scan_file = &FileScannerPCRE2::ScanFileWith<ScanStrategy::LINE_PREFILTER>;
+	}
+	else if(m_use_multi_lit_prefix)
+	{
+		m_scan_file = &FileScannerPCRE2::ScanFileWith<ScanStrategy::MULTI_LIT_PREFIX>;
+	}
+	else if(m_use_lit_prefix)
+	{
+		m_scan_file = &FileScannerPCRE2::ScanFileWith<ScanStrategy::LIT_PREFIX>;
+	}
+	else if(m_use_inner_literal)
+	{
+		m_scan_file = &FileScannerPCRE2::ScanFileWith<ScanStrategy::INNER_LITERAL>;
+	}
+	else if(m_use_line_start_literal)
+	{
+		m_scan_file = &FileScannerPCRE2::ScanFileWith<ScanStrategy::LINE_START_LITERAL>;
+	}
+	else if(m_use_first_code_unit_table && m_end_fpcu_table == 1)
+	{
+		m_scan_file = &FileScannerPCRE2::ScanFileWith<ScanStrategy::FIRST_CODE_UNIT>;
+	}
+	else if(m_use_first_code_unit_table && m_end_fpcu_table > 1)
+	{
+		m_scan_file = &FileScannerPCRE2::ScanFileWith<ScanStrategy::FIRST_CODE_UNITS>;
+	}
+	else
+	{
+		m_scan_file = &FileScannerPCRE2::ScanFileWith<ScanStrategy::PCRE2_ONLY>;
+	}
+}
+
+bool FileScannerPCRE2::FindLineStartLiteral(const char * __restrict__ file_data, size_t file_size, size_t start_offset,
+		size_t *line_start) const noexcept
+{
+	// Searching for the literal with the vectorized LiteralMatch() and checking what's before each hit is much faster
+	// than hopping from line to line checking what's after each newline, since code lines are short.
+	const uint8_t * const literal = m_literal_search_string.get();
+	const size_t literal_len = m_literal_search_string_len;
+
+	// Without indentation, the literal we search for is the one from the regex with the newline before it, so that
+	// LiteralMatch() only finds it at line starts.  The first line has no newline before it, so check it separately.
+	const bool after_newline = (literal[0] == '\n');
+	if(after_newline && start_offset == 0 && file_size >= literal_len-1)
+	{
+		bool found = std::equal(literal+1, literal+literal_len, file_data, [this](uint8_t l, char c){
+			return l == static_cast<uint8_t>(m_literal_ignore_case ? ascii_tolower(c) : c);
+		});
+		if(found)
+		{
+			*line_start = 0;
+			return true;
+		}
+	}
+
+	size_t ovector[2];
+	size_t offset = (after_newline && start_offset > 0) ? start_offset-1 : start_offset;
+	while(offset < file_size)
+	{
+		if((this->*LiteralMatch)(file_data, file_size, offset, ovector) <= 0)
+		{
+			// No more of them, so no more lines which start with one.
+			return false;
+		}
+
+		if(after_newline)
+		{
+			*line_start = ovector[0] + 1;
+			return true;
+		}
+
+		// Back up over any indentation, which has to take us to the start of the line.
+		const char *lit = file_data + ovector[0];
+		const char *p = lit;
+		while(p > file_data && m_line_start_indent[static_cast<uint8_t>(p[-1])])
+		{
+			--p;
+		}
+		if((p == file_data || p[-1] == '\n') && (p < lit || !m_line_start_indent_required)
+				&& p >= file_data + start_offset)
+		{
+			*line_start = p - file_data;
+			return true;
+		}
+
+		// The literal can only be right after the line's indentation, which is no later than this hit, so nothing
+		// else on this line can be it either.
+		const char *line_end = static_cast<const char *>(std::memchr(lit, '\n', file_size - ovector[0]));
+		if(line_end == nullptr)
+		{
+			return false;
+		}
+		offset = line_end + 1 - file_data;
+	}
+
+	return false;
 }
 
 void FileScannerPCRE2::ScanFile(int thread_index, const char* __restrict__ file_data, size_t file_size, MatchList& ml)
+{
+	(this->*m_scan_file)(thread_index, file_data, file_size, ml);
+}
+
+template <FileScannerPCRE2::ScanStrategy Strategy>
+void FileScannerPCRE2::ScanFileWith(int thread_index, const char* __restrict__ file_data, size_t file_size, MatchList& ml)
 {
 #if HAVE_LIBPCRE2
+	// Whether libpcre2 is finding the matches, or only our own matchers are.
+	constexpr bool use_pcre2 = (Strategy != ScanStrategy::LITERAL) && (Strategy != ScanStrategy::LITERAL_WORD)
+			&& (Strategy != ScanStrategy::MULTI_LITERAL);
+	// Whether libpcre2 is limited to one line at a time, with pcre2_set_offset_limit().
+	constexpr bool use_line_limit = (Strategy == ScanStrategy::LINE_PREFILTER) || (Strategy == ScanStrategy::INNER_LITERAL)
+			|| (Strategy == ScanStrategy::LINE_START_LITERAL);
+
+	// The multiversioned search functions we'll be using.  They were resolved when the FileScanner was constructed,
+	// and won't change while we're scanning.
+	const auto literal_match = LiteralMatch;
+	const auto find_first_possible_cu = (Strategy == ScanStrategy::FIRST_CODE_UNIT) ? find : find_first_of;
+
 	try
 	{
 	// Pointer to the offset vector returned by pcre2_match().
@@ -312,6 +965,13 @@ void FileScannerPCRE2::ScanFile(int thread_index, const char* __restrict__ file_
 	const char *prev_lineno_search_end {file_data};
 	size_t start_offset { 0 };
 
+	// When we stop trusting libpcre2 to get through this file in reasonable time.
+	std::chrono::steady_clock::time_point deadline {};
+	if(use_pcre2 && m_match_time_limit != 0)
+	{
+		deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(m_match_time_limit);
+	}
+
 	ovector = pcre2_get_ovector_pointer(m_match_data[thread_index].get());
 	// Fool the "previous match was zero-length" logic for the first iteration.
 	ovector[0] = -1;
@@ -339,14 +999,46 @@ void FileScannerPCRE2::ScanFile(int thread_index, const char* __restrict__ file_
 		}
 
 		int rc = 0;
-		if(options==0 && !m_use_literal)
+		// With use_line_limit, the end of the line libpcre2 is limited to.
+		PCRE2_SIZE line_end_offset = file_size;
+		if(use_pcre2 && options==0)
 		{
-			if(m_use_lit_prefix)
+			if constexpr(Strategy == ScanStrategy::LINE_PREFILTER)
+			{
+				// Have the derived class find the next line which might have a match on it, and only let libpcre2
+				// look at that line.
+				size_t line_start;
+				if(!FindCandidateLine(thread_index, file_data, file_size, start_offset, &line_start, &line_end_offset))
+				{
+					// Nothing left that can match.
+					break;
+				}
+				start_offset = line_start;
+				pcre2_set_offset_limit(m_match_context[thread_index].get(), line_end_offset);
+			}
+			else if constexpr(Strategy == ScanStrategy::MULTI_LIT_PREFIX)
+			{
+				PCRE2_SIZE old_ovector[2] = { ovector[0], ovector[1] };
+				// Find the first of the literal alternatives the regex starts with.
+				rc = MultiLiteralMatch(file_data, file_size, start_offset, ovector);
+				if(rc <= 0)
+				{
+					// Couldn't find any of them, regex can't match.
+					break;
+				}
+				else
+				{
+					// Rewind a bit and let libpcre2 do its thing.
+					start_offset = ovector[0];
+					ovector[0] = old_ovector[0];
+					ovector[1] = old_ovector[1];
+				}
+			}
+			else if constexpr(Strategy == ScanStrategy::LIT_PREFIX)
 			{
 				PCRE2_SIZE old_ovector[2] = { ovector[0], ovector[1] };
 				// Find the literal prefix.
-				/// @todo std::invoke from C++17 might be better here.
-				rc = (this->*LiteralMatch)(file_data, file_size, start_offset, ovector);
+				rc = (this->*literal_match)(file_data, file_size, start_offset, ovector);
 				if(ovector[0] > file_size)
 				{
 					break;
@@ -364,24 +1056,47 @@ void FileScannerPCRE2::ScanFile(int thread_index, const char* __restrict__ file_
 					ovector[1] = old_ovector[1];
 				}
 			}
-			else if(m_use_first_code_unit_table)
+			else if constexpr(Strategy == ScanStrategy::INNER_LITERAL)
 			{
-				// Burn through chars we know aren't at the start of the match.
-				auto first_possible_char = FindFirstPossibleCodeUnit_default(file_data+start_offset, file_size-start_offset);
-				if(first_possible_char != file_data+file_size)
+				PCRE2_SIZE old_ovector[2] = { ovector[0], ovector[1] };
+				// Find the next occurrence of the literal every match contains.
+				rc = (this->*literal_match)(file_data, file_size, start_offset, ovector);
+				if(rc <= 0)
 				{
-					// Found one.
-					start_offset = first_possible_char - file_data;
+					// Couldn't find it, regex can't match.
+					break;
 				}
-				else
+
+				// A match can't span lines, so any match containing this occurrence is on its line, and there's none
+				// starting before the line (else it would contain an earlier occurrence).  Have libpcre2 look for one
+				// starting no earlier than the line and no later than its end.
+				std::reverse_iterator<const char*> rstart(file_data + ovector[0]);
+				std::reverse_iterator<const char*> rend(file_data + start_offset);
+				start_offset = std::find(rstart, rend, '\n').base() - file_data;
+				const char *line_end = static_cast<const char *>(std::memchr(file_data+ovector[1], '\n', file_size-ovector[1]));
+				line_end_offset = (line_end == nullptr) ? file_size : line_end - file_data;
+				pcre2_set_offset_limit(m_match_context[thread_index].get(), line_end_offset);
+				ovector[0] = old_ovector[0];
+				ovector[1] = old_ovector[1];
+			}
+			else if constexpr(Strategy == ScanStrategy::LINE_START_LITERAL)
+			{
+				// Find the next line which starts with the literal.  No match can start anywhere but the start of a
+				// line, so have libpcre2 only try there.  (PCRE2_ANCHORED would do that too, but libpcre2 doesn't
+				// use the JIT for it if it's only given at match time.)
+				if(!FindLineStartLiteral(file_data, file_size, start_offset, &start_offset))
 				{
-					// Found nothing, the regex can't match.
+					// No more such lines, the regex can't match.
 					break;
 				}
+				const char *line_end = static_cast<const char *>(std::memchr(file_data+start_offset, '\n', file_size-start_offset));
+				line_end_offset = (line_end == nullptr) ? file_size : line_end - file_data;
+				pcre2_set_offset_limit(m_match_context[thread_index].get(), line_end_offset);
 			}
-			else if(m_use_range_pair_table)
+			else if constexpr(Strategy == ScanStrategy::FIRST_CODE_UNIT || Strategy == ScanStrategy::FIRST_CODE_UNITS)
 			{
-				auto first_possible_char = find_first_in_ranges_sse4_2_popcnt(file_data+start_offset, file_size-start_offset);
+				// Burn through chars we know aren't at the start of the match.
+				auto first_possible_char = (this->*find_first_possible_cu)(file_data+start_offset, file_size-start_offset);
 				if(first_possible_char != file_data+file_size)
 				{
 					// Found one.
@@ -395,7 +1110,19 @@ void FileScannerPCRE2::ScanFile(int thread_index, const char* __restrict__ file_
 			}
 		}
 
-		if(!m_use_literal)
+		if constexpr(Strategy == ScanStrategy::MULTI_LITERAL)
+		{
+			rc = MultiLiteralMatch(file_data, file_size, start_offset, ovector);
+		}
+		else if constexpr(Strategy == ScanStrategy::LITERAL_WORD)
+		{
+			rc = LiteralWordMatch(file_data, file_size, start_offset, ovector);
+		}
+		else if constexpr(Strategy == ScanStrategy::LITERAL)
+		{
+			rc = (this->*literal_match)(file_data, file_size, start_offset, ovector);
+		}
+		else
 		{
 			// Try to match the regex to whatever's left of the file.
 			rc = pcre2_match(
@@ -407,17 +1134,28 @@ void FileScannerPCRE2::ScanFile(int thread_index, const char* __restrict__ file_
 					m_match_data[thread_index].get(),
 					m_match_context[thread_index].get()
 					);
-		}
-		else
-		{
-			/// @todo std::invoke from C++17 might be better here.
-			rc = (this->*LiteralMatch)(file_data, file_size, start_offset, ovector);
+
+			bool over_time = (m_match_time_limit != 0) && (std::chrono::steady_clock::now() > deadline);
+			if(over_time || is_match_limit_error(rc))
+			{
+				// libpcre2 is bogged down in this file, most likely backtracking catastrophically somewhere after
+				// start_offset.  Finish the file a line at a time, where no match attempt can wander off very far.
+				line_no += CountLinesSinceLastMatch(prev_lineno_search_end, file_data+start_offset);
+				ScanLinesWithFallback(thread_index, file_data, file_size, start_offset, line_no, prev_lineno, over_time, deadline, ml);
+				break;
+			}
 		}
 
 		// Check for no match.
 		if(rc == PCRE2_ERROR_NOMATCH)
 		{
-			if(options == 0 )
+			if(use_line_limit && options == 0 && line_end_offset < file_size)
+			{
+				// Only the line we limited libpcre2 to had no match.  Look for the next candidate line after it.
+				ovector[0] = line_end_offset;
+				ovector[1] = line_end_offset + 1;
+			}
+			else if(options == 0 )
 			{
 				// We weren't trying to recover from a zero-length match, so there are no more matches.
 				// Break out of the loop.
@@ -484,20 +1222,36 @@ void FileScannerPCRE2::ScanFile(int thread_index, const char* __restrict__ file_
 			return;
 		}
 
+		if(m_first_match_only)
+		{
+			// All we need to know is that there's a match.
+			ml.SetFileMatched();
+			break;
+		}
+
 		try
 		{
 			// There was a match.  Package it up in the MatchList which was passed in.
 			line_no += CountLinesSinceLastMatch(prev_lineno_search_end, file_data+ovector[0]);
 			prev_lineno_search_end = file_data+ovector[0];
-			if(line_no == prev_lineno)
-			{
-				// Skip multiple matches on one line.
-				continue;
-			}
 			prev_lineno = line_no;
 			Match m(file_data, file_size, ovector[0], ovector[1], line_no);
+			m.m_pattern_number = GetPatternNumber(thread_index, file_data, ovector);
 
 			ml.AddMatch(std::move(m));
+
+			// We only report the first match on a line, so don't go looking for any more on this one.  Resume the
+			// search at the start of the next line, which we tell the loop as if the line's newline were the match.
+			// The last character of a non-empty match is still on the match's line, even if it's the newline.
+			size_t last_char = (ovector[1] > ovector[0]) ? ovector[1]-1 : ovector[0];
+			const char *line_end = static_cast<const char *>(std::memchr(file_data+last_char, '\n', file_size-last_char));
+			if(line_end == nullptr || line_end+1 == file_data+file_size)
+			{
+				// That was the last line, there's nothing after its newline (if it has one) to search.
+				break;
+			}
+			ovector[0] = line_end - file_data;
+			ovector[1] = ovector[0] + 1;
 		}
 		catch(...)
 		{
@@ -516,9 +1270,183 @@ void FileScannerPCRE2::ScanFile(int thread_index, const char* __restrict__ file_
 	{
 		RETHROW("Caught exception here.");
 	}
+#else
+	(void)thread_index;
+	(void)file_data;
+	(void)file_size;
+	(void)ml;
+#endif // HAVE_LIBPCRE2
+}
+
+void FileScannerPCRE2::ScanLinesWithFallback(int thread_index, const char * __restrict__ file_data, size_t file_size, size_t start_offset,
+		size_t line_no, size_t prev_lineno, bool dfa_only, std::chrono::steady_clock::time_point deadline, MatchList &ml)
+{
+#if HAVE_LIBPCRE2
+	m_num_files_limited++;
+
+	pcre2_match_data *match_data = m_match_data[thread_index].get();
+	pcre2_match_context *match_context = m_match_context[thread_index].get();
+	PCRE2_SIZE *ovector = pcre2_get_ovector_pointer(match_data);
+	int dfa_workspace[f_dfa_workspace_size];
+
+	// We're limiting the subject to each line ourselves, and a prefilter's offset limit would get in the way.
+	pcre2_set_offset_limit(match_context, PCRE2_UNSET);
+
+	size_t line_start = start_offset;
+	while(line_start < file_size)
+	{
+		const char *nl = static_cast<const char *>(std::memchr(file_data+line_start, '\n', file_size-line_start));
+		size_t line_end = (nl == nullptr) ? file_size : nl - file_data;
+
+		if(line_no != prev_lineno)
+		{
+			// The subject ends after the line's newline, so that '$' and lookaheads see the same thing they would in the
+			// whole file.  Anything earlier in the file is still there for lookbehinds.
+			PCRE2_SIZE subject_length = (nl == nullptr) ? file_size : line_end+1;
+			int rc = PCRE2_ERROR_MATCHLIMIT;
+
+			if(!dfa_only)
+			{
+				rc = pcre2_match(m_pcre2_regex, reinterpret_cast<PCRE2_SPTR>(file_data), subject_length, line_start, 0,
+						match_data, match_context);
+				if(m_match_time_limit != 0 && std::chrono::steady_clock::now() > deadline)
+				{
+					// Out of time, don't give libpcre2 any more chances to backtrack.
+					dfa_only = true;
+				}
+			}
+
+			bool dfa_matched = false;
+			if(is_match_limit_error(rc))
+			{
+				rc = pcre2_dfa_match(m_pcre2_dfa_regex ? m_pcre2_dfa_regex.get() : m_pcre2_regex,
+						reinterpret_cast<PCRE2_SPTR>(file_data), subject_length, line_start, 0,
+						match_data, match_context, dfa_workspace, f_dfa_workspace_size);
+				dfa_matched = true;
+				m_num_lines_dfa_matched++;
+				if(rc < 0 && rc != PCRE2_ERROR_NOMATCH)
+				{
+					// Neither matcher could get through the line within the limits (or the regex has something the
+					// DFA matcher doesn't support, like a backreference).  All we can do is skip it, and say so.
+					m_num_lines_skipped++;
+					ml.AddUnmatchedLine();
+					rc = PCRE2_ERROR_NOMATCH;
+				}
+			}
+
+			if(rc >= 0 && ovector[0] <= line_end)
+			{
+				// A match on this line.  With pcre2_dfa_match(), rc == 0 means there was more than one, and the
+				// ovector holds the longest.
+				if(m_first_match_only)
+				{
+					ml.SetFileMatched();
+					return;
+				}
+				Match m(file_data, file_size, ovector[0], ovector[1], line_no);
+				if(dfa_matched && m_pcre2_dfa_regex)
+				{
+					m.m_pattern_number = GetPatternNumberWithoutMark(thread_index, file_data, subject_length, ovector[0], dfa_workspace);
+				}
+				else
+				{
+					m.m_pattern_number = GetPatternNumber(thread_index, file_data, ovector);
+				}
+				ml.AddMatch(std::move(m));
+			}
+			else if(rc < 0 && rc != PCRE2_ERROR_NOMATCH)
+			{
+				throw FileScannerException(std::string("PCRE2 match error: ") + PCRE2ErrorCodeToErrorString(rc));
+			}
+		}
+
+		line_start = line_end+1;
+		++line_no;
+	}
+#else
+	(void)thread_index;
+	(void)file_data;
+	(void)file_size;
+	(void)start_offset;
+	(void)line_no;
+	(void)prev_lineno;
+	(void)dfa_only;
+	(void)deadline;
+	(void)ml;
 #endif // HAVE_LIBPCRE2
 }
 
+size_t FileScannerPCRE2::GetPatternNumber(int thread_index, const char * __restrict__ file_data, const size_t *ovector) const noexcept
+{
+	if(m_pattern_numbers.size() <= 1)
+	{
+		// Not reporting pattern numbers, or there's only the one pattern.
+		return m_pattern_numbers.empty() ? 0 : m_pattern_numbers[0];
+	}
+
+	if(m_multi_literal)
+	{
+		// CombinePatterns() made an alternation of literals, so the matched text is the literal which matched.
+		size_t index = m_multi_literal->IndexOf(file_data + ovector[0], ovector[1] - ovector[0]);
+		return (index < m_pattern_numbers.size()) ? m_pattern_numbers[index] : 0;
+	}
+
+#if HAVE_LIBPCRE2
+	// Otherwise, the pattern which matched passed its (*MARK:n) on the way to the match.
+	PCRE2_SPTR mark = pcre2_get_mark(m_match_data[thread_index].get());
+	if(mark != nullptr)
+	{
+		size_t index = std::strtoul(reinterpret_cast<const char *>(mark), nullptr, 10) - 1;
+		return (index < m_pattern_numbers.size()) ? m_pattern_numbers[index] : 0;
+	}
+#else
+	(void)thread_index;
+#endif
+
+	return 0;
+}
+
+size_t FileScannerPCRE2::GetPatternNumberWithoutMark(int thread_index, const char * __restrict__ file_data, size_t subject_length,
+		size_t match_start, int *dfa_workspace)
+{
+#if HAVE_LIBPCRE2
+	if(m_pattern_numbers.size() != m_pattern_regexes.size())
+	{
+		// Not reporting pattern numbers.
+		return 0;
+	}
+
+	std::call_once(m_pattern_dfa_regexes_once, [this](){
+		for(const std::string &pattern_regex : m_pattern_regexes)
+		{
+			std::string regex = pattern_regex;
+			int error_code;
+			PCRE2_SIZE error_offset;
+			m_pattern_dfa_regexes.emplace_back(CompileSingleLineRegex(&regex, m_regex_compile_options, &error_code, &error_offset));
+		}
+	});
+
+	// The combined regex matched the first pattern which matches at the leftmost match start.
+	for(size_t i = 0; i < m_pattern_dfa_regexes.size(); ++i)
+	{
+		if(m_pattern_dfa_regexes[i] && pcre2_dfa_match(m_pattern_dfa_regexes[i].get(), reinterpret_cast<PCRE2_SPTR>(file_data),
+				subject_length, match_start, PCRE2_ANCHORED, m_match_data[thread_index].get(), m_match_context[thread_index].get(),
+				dfa_workspace, f_dfa_workspace_size) >= 0)
+		{
+			return m_pattern_numbers[i];
+		}
+	}
+#else
+	(void)thread_index;
+	(void)file_data;
+	(void)subject_length;
+	(void)match_start;
+	(void)dfa_workspace;
+#endif
+
+	return 0;
+}
+
 std::string FileScannerPCRE2::PCRE2ErrorCodeToErrorString(int errorcode)
 {
 	std::string retstr;
@@ -26,6 +26,11 @@
 
 #include <libext/memory.hpp>
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
 #if HAVE_LIBPCRE2
 #define PCRE2_CODE_UNIT_WIDTH 8
 #include <pcre2.h>
@@ -52,6 +57,13 @@ namespace std
 		{ pcre2_match_context_free(mctx); };
 	};
 
+	template<>
+	struct default_delete<pcre2_code>
+	{
+		void operator()(pcre2_code *code)
+		{ pcre2_code_free(code); };
+	};
+
 }
 /// @}
 #endif  // HAVE_LIBPCRE2
@@ -64,7 +76,8 @@ public:
 			std::string regex,
 			bool ignore_case,
 			bool word_regexp,
-			bool pattern_is_literal);
+			bool pattern_is_literal,
+			bool use_offset_limit = false);
 	~FileScannerPCRE2() override;
 
 	/**
@@ -73,7 +86,28 @@ public:
 	 */
 	static std::string GetPCRE2Version() noexcept;
 
-	void ThreadLocalSetup(int thread_count) final;
+	void ThreadLocalSetup(int thread_count) override;
+
+protected:
+
+	/**
+	 * Find the first line which might contain a match starting at or after @a start_offset.  Derived classes which
+	 * have a faster way than libpcre2 of ruling lines out override this and set m_use_line_prefilter, and libpcre2
+	 * then only looks at the lines this returns.  Requires the regex to have been compiled with use_offset_limit.
+	 *
+	 * @param thread_index
+	 * @param file_data
+	 * @param file_size
+	 * @param start_offset
+	 * @param line_start  Set to the offset of the start of the line, or to @a start_offset if that's later.
+	 * @param line_end    Set to the offset of the line's terminating '\n', or to @a file_size if it has none.
+	 * @return false if nothing in the rest of the file can match, else true.
+	 */
+	virtual bool FindCandidateLine(int thread_index, const char * __restrict__ file_data, size_t file_size, size_t start_offset,
+			size_t *line_start, size_t *line_end) noexcept;
+
+	/// If true, ScanFile() only hands libpcre2 the lines FindCandidateLine() finds.
+	bool m_use_line_prefilter { false };
 
 private:
 
@@ -92,14 +126,108 @@ private:
 	 */
 	void ScanFile(int thread_index, const char * __restrict__ file_data, size_t file_size, MatchList &ml) final;
 
+	/// The ways ScanFile() can find the matches, or narrow down where libpcre2 has to look for them.
+	enum class ScanStrategy
+	{
+		LITERAL,			//!< m_use_literal: LiteralMatch() finds the matches, no libpcre2.
+		LITERAL_WORD,		//!< m_use_literal with m_word_regexp: LiteralWordMatch() finds the matches.
+		MULTI_LITERAL,		//!< m_use_multi_literal: MultiLiteralMatch() finds the matches.
+		LINE_PREFILTER,		//!< m_use_line_prefilter: libpcre2 on the lines FindCandidateLine() finds.
+		MULTI_LIT_PREFIX,	//!< m_use_multi_lit_prefix: libpcre2 starting at each MultiLiteralMatch() hit.
+		LIT_PREFIX,			//!< m_use_lit_prefix: libpcre2 starting at each LiteralMatch() hit.
+		INNER_LITERAL,		//!< m_use_inner_literal: libpcre2 on the lines LiteralMatch() finds.
+		LINE_START_LITERAL,	//!< m_use_line_start_literal: libpcre2 on the lines FindLineStartLiteral() finds.
+		FIRST_CODE_UNIT,	//!< m_use_first_code_unit_table with one code unit: libpcre2 starting at each find() hit.
+		FIRST_CODE_UNITS,	//!< m_use_first_code_unit_table: libpcre2 starting at each find_first_of() hit.
+		PCRE2_ONLY			//!< libpcre2 does all the work.
+	};
+
+	/**
+	 * ScanFile() specialized for one ScanStrategy, so that the scan loop doesn't have to keep checking which
+	 * of the prefilters and matchers it's supposed to be using.
+	 */
+	template <ScanStrategy Strategy>
+	void ScanFileWith(int thread_index, const char * __restrict__ file_data, size_t file_size, MatchList &ml);
+
+	/**
+	 * Pick the ScanFileWith<> instantiation for what AnalyzeRegex() and any derived class constructor found we
+	 * could do.
+	 */
+	void SelectScanStrategy() noexcept;
+
+	/// The ScanFileWith<> instantiation ScanFile() calls.
+	void (FileScannerPCRE2::*m_scan_file)(int thread_index, const char * __restrict__ file_data, size_t file_size, MatchList &ml)
+		{ nullptr };
+
+	/**
+	 * Find the first line starting at or after @a start_offset which begins with m_literal_search_string, after any
+	 * indentation made of m_line_start_indent bytes.  If there's no indentation, m_literal_search_string has the newline
+	 * before the literal prepended.  If @a start_offset isn't at the start of a line, its line is skipped.
+	 *
+	 * @param line_start  Set to the offset of the start of the line.
+	 * @return false if there's no such line in the rest of the file, else true.
+	 */
+	bool FindLineStartLiteral(const char * __restrict__ file_data, size_t file_size, size_t start_offset, size_t *line_start) const noexcept;
+
+	/**
+	 * Finish scanning @a file_data one line at a time, for when ScanFile() hits the match limit or match time limit.
+	 * Each line gets one pcre2_match() call, which can only backtrack within the line.  Lines where that still hits the
+	 * match limit, and all lines once the time limit has passed, get pcre2_dfa_match() instead, which doesn't backtrack.
+	 *
+	 * @param start_offset  Where to start scanning.
+	 * @param line_no       Line number of the line @a start_offset is on.
+	 * @param prev_lineno   Line number of the last line a match was added to @a ml for.
+	 * @param dfa_only      If true, use only pcre2_dfa_match().
+	 * @param deadline      When the match time limit runs out, if there is one.
+	 */
+	void ScanLinesWithFallback(int thread_index, const char * __restrict__ file_data, size_t file_size, size_t start_offset,
+			size_t line_no, size_t prev_lineno, bool dfa_only, std::chrono::steady_clock::time_point deadline, MatchList &ml);
+
+	/**
+	 * Returns the number of the pattern the match in @a ovector matched, or 0 if we're not reporting pattern numbers.
+	 * Must be called before anything else uses this thread's match data.
+	 */
+	size_t GetPatternNumber(int thread_index, const char * __restrict__ file_data, const size_t *ovector) const noexcept;
+
+	/**
+	 * GetPatternNumber() for a match pcre2_dfa_match() found, which doesn't record (*MARK)s.  Returns the number of the
+	 * first of the patterns which matches at @a match_start, or 0 if none do.  Uses this thread's match data.
+	 */
+	size_t GetPatternNumberWithoutMark(int thread_index, const char * __restrict__ file_data, size_t subject_length,
+			size_t match_start, int *dfa_workspace);
+
+#if HAVE_LIBPCRE2
+	/**
+	 * Compile @a regex, surrounded with \b's if m_word_regexp, and rewritten or wrapped so that it can't match a newline.
+	 *
+	 * @param regex  In: the regex.  Out: what was last handed to pcre2_compile().
+	 * @return  The compiled regex, or nullptr if it didn't compile, with @a error_code and @a error_offset set.
+	 */
+	pcre2_code* CompileSingleLineRegex(std::string *regex, uint32_t compile_options, int *error_code, PCRE2_SIZE *error_offset) const;
+#endif
+
 	static std::string PCRE2ErrorCodeToErrorString(int errorcode);
 
+	/// Number of ints of workspace to give pcre2_dfa_match().
+	static constexpr size_t f_dfa_workspace_size = 4096;
+
 #if HAVE_LIBPCRE2
-	/// The compiled libpcre2 regex.
+	/// The compiled libpcre2 regex.  nullptr if libpcre2 couldn't compile it, but the multi-literal search is doing all
+	/// the matching anyway.
 	/// @todo Make this a unique_ptr<>, RAII-ify it.
 	//std::unique_ptr<pcre2_code, void(*)(pcre2_code*)> m_pcre2_regex;
 	pcre2_code *m_pcre2_regex;
 
+	/// The options m_pcre2_regex was compiled with.
+	uint32_t m_regex_compile_options {0};
+
+	/// If m_pcre2_regex has (*MARK)s, which pcre2_dfa_match() rejects, a copy of it without them for that to use.
+	std::unique_ptr<pcre2_code> m_pcre2_dfa_regex;
+
+	/// Each of the m_pattern_regexes, compiled for GetPatternNumberWithoutMark() the first time it's needed.
+	std::vector<std::unique_ptr<pcre2_code>> m_pattern_dfa_regexes;
+	std::once_flag m_pattern_dfa_regexes_once;
+
 	/// @note This and m_match_context are a pseudo-thread_local mechanism for systems which
 	/// don't support real C++ thread_local's (older Mac OS X).
 	std::vector<std::unique_ptr<pcre2_match_data>> m_match_data;
@@ -110,7 +238,29 @@ private:
 
 	bool m_use_first_code_unit_table { false };
 
-	bool m_use_range_pair_table { false };
+	/// Set by AnalyzeRegex() if every match starts at the start of a line, and has m_literal_search_string there after
+	/// any indentation.
+	bool m_use_line_start_literal { false };
+
+	/// Which bytes the indentation before the line start literal can be made of.
+	std::array<bool, 256> m_line_start_indent {};
+
+	/// Whether there has to be at least one byte of indentation before the line start literal.
+	bool m_line_start_indent_required { false };
+
+	/// @name Match limit fallback stats.
+	/// @{
+
+	/// Number of files which hit the match limit or match time limit and were finished by ScanLinesWithFallback().
+	std::atomic<size_t> m_num_files_limited {0};
+
+	/// Number of lines which were matched with pcre2_dfa_match().
+	std::atomic<size_t> m_num_lines_dfa_matched {0};
+
+	/// Number of lines which hit the limits with both matchers, and so were skipped.
+	std::atomic<size_t> m_num_lines_skipped {0};
+
+	/// @}
 };
 
 #endif /* SRC_FILESCANNERPCRE2_H_ */
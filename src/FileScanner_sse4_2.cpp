@@ -23,12 +23,15 @@
 
 // Std C++.
 #include <cstdint>
+#include <cstring> // For memcmp().
+#include <algorithm>
 
 #include <immintrin.h>
 
 #include <libext/multiversioning.hpp>
 #include <libext/hints.hpp>
 #include <libext/memory.hpp>
+#include <libext/string.hpp>
 
 
 #ifdef __SSE2__
@@ -49,8 +52,337 @@ STATIC_MSG("Have POPCNT")
 #ifdef __AVX__
 STATIC_MSG("Have AVX")
 #endif
+#ifdef __AVX2__
+STATIC_MSG("Have AVX2")
+#endif
+#ifdef __AVX512BW__
+STATIC_MSG("Have AVX512BW")
+#endif
+
+
+#if defined(__AVX2__)
+
+/// @name Wide-vector kernels.
+/// The AVX2 and AVX-512BW builds of this file share these versions of the kernels, written in terms of the few
+/// operations below.  They operate on 32 or 64 bytes at a time instead of 16, and mostly use unaligned loads, which
+/// cost next to nothing on any CPU which has AVX2.
+/// @{
+
+#if defined(__AVX512BW__)
+using wide_vec_t = __m512i;
+/// Bitmask with one bit per byte of a wide_vec_t.
+using wide_mask_t = uint64_t;
+
+static inline wide_vec_t wide_loadu(const char *p) noexcept { return _mm512_loadu_si512(p); }
+static inline wide_vec_t wide_set1(char c) noexcept { return _mm512_set1_epi8(c); }
+static inline wide_mask_t wide_cmpeq(wide_vec_t a, wide_vec_t b) noexcept { return _mm512_cmpeq_epi8_mask(a, b); }
+/// Bit i is set if lo <= a[i] <= lo+span, unsigned.
+static inline wide_mask_t wide_in_range(wide_vec_t a, wide_vec_t lo, wide_vec_t span) noexcept
+{
+	return _mm512_cmple_epu8_mask(_mm512_sub_epi8(a, lo), span);
+}
+/// ASCII-lowercase each byte of a.
+static inline wide_vec_t wide_tolower(wide_vec_t a) noexcept
+{
+	wide_mask_t is_upper = _mm512_cmple_epu8_mask(_mm512_sub_epi8(a, _mm512_set1_epi8('A')), _mm512_set1_epi8('Z'-'A'));
+	return _mm512_mask_add_epi8(a, is_upper, a, _mm512_set1_epi8(0x20));
+}
+/// Broadcast a 16-byte table to every 128-bit lane, for wide_in_nibble_class().
+static inline wide_vec_t wide_broadcast_table(const uint8_t *table) noexcept
+{
+	// The maskz version with all lanes set, because gcc warns about the undefined vector the unmasked one passes in.
+	return _mm512_maskz_broadcast_i32x4(static_cast<__mmask16>(0xFFFF), _mm_load_si128(reinterpret_cast<const __m128i*>(table)));
+}
+/// Bit i is set if lo_table[a[i] & 0x0F] & hi_table[a[i] >> 4] is nonzero.
+static inline wide_mask_t wide_in_nibble_class(wide_vec_t a, wide_vec_t lo_table, wide_vec_t hi_table) noexcept
+{
+	const __m512i low_nibble_mask = _mm512_set1_epi8(0x0F);
+	__m512i lo = _mm512_shuffle_epi8(lo_table, _mm512_and_si512(a, low_nibble_mask));
+	__m512i hi = _mm512_shuffle_epi8(hi_table, _mm512_and_si512(_mm512_srli_epi16(a, 4), low_nibble_mask));
+	return _mm512_test_epi8_mask(lo, hi);
+}
+#else
+using wide_vec_t = __m256i;
+using wide_mask_t = uint32_t;
+
+static inline wide_vec_t wide_loadu(const char *p) noexcept { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+static inline wide_vec_t wide_set1(char c) noexcept { return _mm256_set1_epi8(c); }
+static inline wide_mask_t wide_cmpeq(wide_vec_t a, wide_vec_t b) noexcept { return _mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b)); }
+static inline wide_mask_t wide_in_range(wide_vec_t a, wide_vec_t lo, wide_vec_t span) noexcept
+{
+	// No unsigned byte compare in AVX2, but x <= span iff min(x, span) == x.
+	__m256i offset = _mm256_sub_epi8(a, lo);
+	return _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_min_epu8(offset, span), offset));
+}
+static inline wide_vec_t wide_tolower(wide_vec_t a) noexcept
+{
+	__m256i offset = _mm256_sub_epi8(a, _mm256_set1_epi8('A'));
+	__m256i is_upper = _mm256_cmpeq_epi8(_mm256_min_epu8(offset, _mm256_set1_epi8('Z'-'A')), offset);
+	return _mm256_or_si256(a, _mm256_and_si256(is_upper, _mm256_set1_epi8(0x20)));
+}
+static inline wide_vec_t wide_broadcast_table(const uint8_t *table) noexcept
+{
+	return _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(table)));
+}
+static inline wide_mask_t wide_in_nibble_class(wide_vec_t a, wide_vec_t lo_table, wide_vec_t hi_table) noexcept
+{
+	const __m256i low_nibble_mask = _mm256_set1_epi8(0x0F);
+	__m256i lo = _mm256_shuffle_epi8(lo_table, _mm256_and_si256(a, low_nibble_mask));
+	__m256i hi = _mm256_shuffle_epi8(hi_table, _mm256_and_si256(_mm256_srli_epi16(a, 4), low_nibble_mask));
+	return ~_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(lo, hi), _mm256_setzero_si256()));
+}
+#endif
+
+static constexpr size_t f_wide_vec_size = sizeof(wide_vec_t);
+static_assert(f_wide_vec_size == 8*sizeof(wide_mask_t), "wide_mask_t must have one bit per byte of wide_vec_t");
+
+static inline size_t wide_popcount(wide_mask_t bits) noexcept { return __builtin_popcountll(bits); }
+
+/// @}
+
+size_t MULTIVERSION(FileScanner::CountLinesSinceLastMatch)(const char * __restrict__ cbegin,
+		const char * __restrict__ cend) noexcept
+{
+	size_t num_lines_since_last_match = 0;
+	const char * __restrict__ last_ptr = cbegin;
+	const wide_vec_t looking_for = wide_set1('\n');
+
+	// Two vectors per iteration, to keep both load ports busy.
+	while(last_ptr + 2*f_wide_vec_size <= cend)
+	{
+		num_lines_since_last_match += wide_popcount(wide_cmpeq(wide_loadu(last_ptr), looking_for));
+		num_lines_since_last_match += wide_popcount(wide_cmpeq(wide_loadu(last_ptr + f_wide_vec_size), looking_for));
+		last_ptr += 2*f_wide_vec_size;
+	}
+	if(last_ptr + f_wide_vec_size <= cend)
+	{
+		num_lines_since_last_match += wide_popcount(wide_cmpeq(wide_loadu(last_ptr), looking_for));
+		last_ptr += f_wide_vec_size;
+	}
+
+	// Count the remaining 0 to vec-size-minus-1 bytes without reading past cend.
+	const size_t len = cend - last_ptr;
+	if(len > 0)
+	{
+#if defined(__AVX512BW__)
+		const __mmask64 valid = (UINT64_C(1) << len) - 1;
+		num_lines_since_last_match += wide_popcount(_mm512_mask_cmpeq_epi8_mask(valid, _mm512_maskz_loadu_epi8(valid, last_ptr), looking_for));
+#else
+		if(static_cast<size_t>(cend - cbegin) >= f_wide_vec_size)
+		{
+			// Load the last full vector of the range, and shift out the bytes we've already counted.
+			wide_mask_t match_bitmask = wide_cmpeq(wide_loadu(cend - f_wide_vec_size), looking_for);
+			num_lines_since_last_match += wide_popcount(match_bitmask >> (f_wide_vec_size - len));
+		}
+		else
+		{
+			for(; last_ptr < cend; ++last_ptr)
+			{
+				num_lines_since_last_match += (*last_ptr == '\n');
+			}
+		}
+#endif
+	}
+
+	return num_lines_since_last_match;
+}
 
+size_t MULTIVERSION(FileScanner::SniffBlock)(const char * __restrict__ cbegin,
+		const char * __restrict__ cend) noexcept
+{
+	size_t longest_line = 0;
+	const char * __restrict__ line_start = cbegin;
+	const char * __restrict__ last_ptr = cbegin;
+
+	const wide_vec_t newlines = wide_set1('\n');
+	const wide_vec_t nuls = wide_set1('\0');
 
+	// Unaligned loads, but we never read past cend.
+	while(last_ptr + f_wide_vec_size <= cend)
+	{
+		wide_vec_t block = wide_loadu(last_ptr);
+
+		// Any NULs mean it's a binary file, and we're done.
+		if(wide_cmpeq(block, nuls) != 0)
+		{
+			return SIZE_MAX;
+		}
+
+		// Measure each line which ends in this vector.
+		wide_mask_t eol_bitmask = wide_cmpeq(block, newlines);
+		while(eol_bitmask != 0)
+		{
+			const char *eol = last_ptr + find_first_set_bit(eol_bitmask) - 1;
+			longest_line = std::max(longest_line, static_cast<size_t>(eol - line_start));
+			line_start = eol + 1;
+			// Clear the lowest set bit.
+			eol_bitmask &= eol_bitmask - 1;
+		}
+
+		last_ptr += f_wide_vec_size;
+	}
+
+	// Take care of any left over bytes.
+	while(last_ptr < cend)
+	{
+		if(*last_ptr == '\0')
+		{
+			return SIZE_MAX;
+		}
+		else if(*last_ptr == '\n')
+		{
+			longest_line = std::max(longest_line, static_cast<size_t>(last_ptr - line_start));
+			line_start = last_ptr + 1;
+		}
+		++last_ptr;
+	}
+
+	// The last line may not be terminated.
+	return std::max(longest_line, static_cast<size_t>(cend - line_start));
+}
+
+const char * MULTIVERSION(FileScanner::find_first_of)(const char * __restrict__ cbegin, size_t len) const noexcept
+{
+	const wide_vec_t lo_table = wide_broadcast_table(m_nibble_lo_table);
+	const wide_vec_t hi_table = wide_broadcast_table(m_nibble_hi_table);
+
+	// @note As with the SSE4.2 version, the last vector may spill over the end of the input into its padding.
+	// We catch any false hits there below.
+	for(size_t i=0; i < len; i+=f_wide_vec_size)
+	{
+		wide_mask_t match_bitmask = wide_in_nibble_class(wide_loadu(cbegin+i), lo_table, hi_table);
+		if(match_bitmask != 0)
+		{
+			return std::min(cbegin + i + find_first_set_bit(match_bitmask) - 1, cbegin + len);
+		}
+	}
+	return cbegin+len;
+}
+
+const char * MULTIVERSION(FileScanner::find)(const char * __restrict__ cbegin, size_t len) const noexcept
+{
+	const wide_vec_t code_unit = wide_set1(m_compiled_cu_bitmap[0]);
+
+	for(size_t i=0; i < len; i+=f_wide_vec_size)
+	{
+		wide_mask_t match_bitmask = wide_cmpeq(wide_loadu(cbegin+i), code_unit);
+		if(match_bitmask != 0)
+		{
+			return std::min(cbegin + i + find_first_set_bit(match_bitmask) - 1, cbegin + len);
+		}
+	}
+	return cbegin+len;
+}
+
+int MULTIVERSION(FileScanner::LiteralMatch)(const char *file_data, size_t file_size, size_t start_offset, size_t *ovector) const noexcept
+{
+	const char * __restrict__ haystack = file_data + start_offset;
+	const size_t haystack_len = file_size - start_offset;
+	const char * __restrict__ needle = reinterpret_cast<const char *>(m_literal_search_string.get());
+	const size_t needle_len = m_literal_search_string_len;
+	const char *str_match = nullptr;
+
+	if(needle_len >= 1 && needle_len <= haystack_len)
+	{
+		// Compare each position against the needle's two rarest bytes, and only do the full compare where both
+		// match.  Two bytes which are rare in source code weed out far more false hits than e.g. the first byte
+		// of "else" would.
+		const size_t rare0 = m_literal_rare_offset[0];
+		const size_t rare1 = m_literal_rare_offset[1];
+		const wide_vec_t rare0_byte = wide_set1(needle[rare0]);
+		const wide_vec_t rare1_byte = wide_set1(needle[rare1]);
+
+		// @note The loads at the rare bytes' offsets may run up to a vector's worth past the end of the data, into its padding.
+		for(size_t i=0; i + needle_len <= haystack_len && str_match == nullptr; i+=f_wide_vec_size)
+		{
+			wide_mask_t candidates = wide_cmpeq(wide_loadu(haystack+i+rare0), rare0_byte)
+					& wide_cmpeq(wide_loadu(haystack+i+rare1), rare1_byte);
+
+			while(candidates != 0)
+			{
+				size_t pos = i + find_first_set_bit(candidates) - 1;
+				if(pos + needle_len > haystack_len)
+				{
+					// This and any later candidates would run off the end.
+					break;
+				}
+				if(std::memcmp(haystack + pos, needle, needle_len) == 0)
+				{
+					str_match = haystack + pos;
+					break;
+				}
+				// Clear the lowest set bit.
+				candidates &= candidates - 1;
+			}
+		}
+	}
+
+	if(str_match == nullptr)
+	{
+		// No match.
+		ovector[0] = file_size;
+		ovector[1] = file_size;
+		return -1; /// @note Both PCRE_ERROR_NOMATCH and PCRE2_ERROR_NOMATCH are both -1.
+	}
+
+	// Found a match.
+	ovector[0] = str_match - file_data;
+	ovector[1] = ovector[0] + needle_len;
+	return 1;
+}
+
+int MULTIVERSION(FileScanner::LiteralMatchCaseless)(const char *file_data, size_t file_size, size_t start_offset, size_t *ovector) const noexcept
+{
+	const char * __restrict__ haystack = file_data + start_offset;
+	const size_t haystack_len = file_size - start_offset;
+	// Already lowercased by AnalyzeRegex().
+	const char * __restrict__ needle = reinterpret_cast<const char *>(m_literal_search_string.get());
+	const size_t needle_len = m_literal_search_string_len;
+	const char *str_match = nullptr;
+
+	if(needle_len >= 1 && needle_len <= haystack_len)
+	{
+		// Same rare byte filter as LiteralMatch(), but on the lowercased haystack.
+		const size_t rare0 = m_literal_rare_offset[0];
+		const size_t rare1 = m_literal_rare_offset[1];
+		const wide_vec_t rare0_byte = wide_set1(needle[rare0]);
+		const wide_vec_t rare1_byte = wide_set1(needle[rare1]);
+
+		for(size_t i=0; i + needle_len <= haystack_len && str_match == nullptr; i+=f_wide_vec_size)
+		{
+			wide_mask_t candidates = wide_cmpeq(wide_tolower(wide_loadu(haystack+i+rare0)), rare0_byte)
+					& wide_cmpeq(wide_tolower(wide_loadu(haystack+i+rare1)), rare1_byte);
+
+			while(candidates != 0)
+			{
+				size_t pos = i + find_first_set_bit(candidates) - 1;
+				if(pos + needle_len > haystack_len)
+				{
+					break;
+				}
+				if(ascii_caseless_equal(haystack + pos, needle, needle_len))
+				{
+					str_match = haystack + pos;
+					break;
+				}
+				candidates &= candidates - 1;
+			}
+		}
+	}
+
+	if(str_match == nullptr)
+	{
+		ovector[0] = file_size;
+		ovector[1] = file_size;
+		return -1;
+	}
+
+	ovector[0] = str_match - file_data;
+	ovector[1] = ovector[0] + needle_len;
+	return 1;
+}
+
+#else // !__AVX2__
 
 static constexpr size_t f_alignment { alignof(__m128i) };
 static constexpr uintptr_t f_alignment_mask { f_alignment-1 };
@@ -208,58 +540,95 @@ size_t MULTIVERSION(FileScanner::CountLinesSinceLastMatch)(const char * __restri
 	return num_lines_since_last_match;
 }
 
+size_t MULTIVERSION(FileScanner::SniffBlock)(const char * __restrict__ cbegin,
+		const char * __restrict__ cend) noexcept
+{
+	constexpr auto vec_size_bytes = sizeof(__m128i);
+
+	size_t longest_line = 0;
+	const char * __restrict__ line_start = cbegin;
+	const char * __restrict__ last_ptr = cbegin;
+
+	const __m128i xmm_newlines = _mm_set1_epi8('\n');
+	const __m128i xmm_nuls = _mm_setzero_si128();
+
+	// Unaligned loads, but we never read past cend.
+	while(last_ptr + vec_size_bytes <= cend)
+	{
+		// Load an xmm register with 16 unaligned bytes.  SSE2.
+		__m128i xmm0 = _mm_loadu_si128((const __m128i *)last_ptr);
+
+		// Any NULs mean it's a binary file, and we're done.  SSE2.
+		uint32_t nul_bitmask = _mm_movemask_epi8(_mm_cmpeq_epi8(xmm0, xmm_nuls));
+		if(nul_bitmask != 0)
+		{
+			return SIZE_MAX;
+		}
+
+		uint32_t eol_bitmask = _mm_movemask_epi8(_mm_cmpeq_epi8(xmm0, xmm_newlines));
+		assume(eol_bitmask <= 0xFFFFU);
+
+		// Measure each line which ends in this vector.
+		while(eol_bitmask != 0)
+		{
+			const char *eol = last_ptr + find_first_set_bit(eol_bitmask) - 1;
+			longest_line = std::max(longest_line, static_cast<size_t>(eol - line_start));
+			line_start = eol + 1;
+			// Clear the lowest set bit.
+			eol_bitmask &= eol_bitmask - 1;
+		}
+
+		last_ptr += vec_size_bytes;
+	}
+
+	// Take care of any left over bytes.
+	while(last_ptr < cend)
+	{
+		if(*last_ptr == '\0')
+		{
+			return SIZE_MAX;
+		}
+		else if(*last_ptr == '\n')
+		{
+			longest_line = std::max(longest_line, static_cast<size_t>(last_ptr - line_start));
+			line_start = last_ptr + 1;
+		}
+		++last_ptr;
+	}
+
+	// The last line may not be terminated.
+	return std::max(longest_line, static_cast<size_t>(cend - line_start));
+}
+
 #if defined(__SSE4_2__)
 
 
 const char * MULTIVERSION(FileScanner::find_first_of)(const char * __restrict__ cbegin, size_t len) const noexcept
 {
 	constexpr auto vec_size_bytes = sizeof(__m128i);
-	constexpr auto vec_size_mask = ~static_cast<decltype(len)>(vec_size_bytes-1);
 
-	uint16_t j=0;
-	size_t i=0;
+	const __m128i lo_table = _mm_load_si128(reinterpret_cast<const __m128i*>(m_nibble_lo_table));
+	const __m128i hi_table = _mm_load_si128(reinterpret_cast<const __m128i*>(m_nibble_hi_table));
+	const __m128i low_nibble_mask = _mm_set1_epi8(0x0F);
 
 	// @note The last vector may spill over the end of the input.  That's ok here, we catch any false
 	// hits in the return statements, and our input should have been allocated with at least a vector's worth of
 	// padding so we don't hit problems there.
-	for(i=0; i < len ; i+=vec_size_bytes)
+	for(size_t i=0; i < len ; i+=vec_size_bytes)
 	{
 		// Load an xmm register with 16 unaligned bytes.  SSE3, L/Th: 1/0.25-0.5, plus cache effects.
-		// "This intrinsic may perform better than _mm_loadu_si128 when the data crosses a cache line boundary."
 		__m128i xmm0 = _mm_lddqu_si128((const __m128i *)(cbegin+i));
 
-		assume(m_end_fpcu_table <= 256);
-
-		for(j=0; j < (m_end_fpcu_table & vec_size_mask); j+=vec_size_bytes)
-		{
-			// Load our compare-to strings.
-			__m128i xmm1_patt = _mm_load_si128((__m128i*)(m_compiled_cu_bitmap+j));
-			// Do the "find_first_of()".
-			int len_a = ((len-i)>vec_size_bytes) ? vec_size_bytes : (len-i);
-			int lsb_set = _mm_cmpestri(xmm1_patt, vec_size_bytes, xmm0, len_a,
-					_SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT);
-
-			if(lsb_set < 16)
-			{
-				return std::min(cbegin + i + lsb_set, cbegin + len);
-			}
-		}
+		// Look up each byte's low and high nibbles in the tables.  SSSE3 pshufb, L/Th: 1/0.5.  The masking keeps bit 7
+		// of the indices clear, else pshufb would give us zeros for bytes >= 0x80.
+		__m128i lo = _mm_shuffle_epi8(lo_table, _mm_and_si128(xmm0, low_nibble_mask));
+		__m128i hi = _mm_shuffle_epi8(hi_table, _mm_and_si128(_mm_srli_epi16(xmm0, 4), low_nibble_mask));
 
-		if(j < m_end_fpcu_table)
+		// The byte is in the set if the two lookups have a bucket bit in common.
+		uint32_t match_bitmask = ~_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())) & 0xFFFFU;
+		if(match_bitmask != 0)
 		{
-			// One partial xmm compare-to register to handle.
-			// Load the last partial compare-to string.
-			__m128i xmm1_patt = _mm_load_si128((__m128i*)(m_compiled_cu_bitmap+j));
-			// Do the "find_first_of()".
-			int len_a = ((len-i)>vec_size_bytes) ? vec_size_bytes : (len-i);
-			int lsb_set = _mm_cmpestri(xmm1_patt, m_end_fpcu_table & (vec_size_bytes-1), xmm0, len_a,
-					_SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT);
-
-			if(lsb_set < 16)
-			{
-				return std::min(cbegin + i + lsb_set, cbegin + len);
-			}
-
+			return std::min(cbegin + i + find_first_set_bit(match_bitmask) - 1, cbegin + len);
 		}
 	}
 	return cbegin+len;
@@ -310,95 +679,127 @@ const char * MULTIVERSION(FileScanner::find)(const char * __restrict__ cbegin, s
 
 #ifdef __POPCNT__ // To eliminate multiple defs.
 
-const char * MULTIVERSION(FileScanner::find_first_in_ranges)(const char * __restrict__ cbegin, size_t len) const noexcept
+int FileScanner::LiteralMatch_sse4_2(const char *file_data, size_t file_size, size_t start_offset, size_t *ovector) const noexcept
 {
-	constexpr auto vec_size_bytes = sizeof(__m128i);
-	constexpr auto vec_size_mask = ~static_cast<decltype(len)>(vec_size_bytes-1);
-
-	uint16_t j=0;
-	size_t i=0;
+	const char * __restrict__ haystack = file_data + start_offset;
+	const size_t haystack_len = file_size - start_offset;
+	const char * __restrict__ needle = reinterpret_cast<const char *>(m_literal_search_string.get());
+	const size_t needle_len = m_literal_search_string_len;
+	const char *str_match = nullptr;
 
-	// @note The last vector may spill over the end of the input.  That's ok here, we catch any false
-	// hits in the return statements, and our input should have been allocated with at least a vector's worth of
-	// padding so we don't hit problems there.
-	for(i=0; i < len ; i+=vec_size_bytes)
+	if(needle_len >= 1 && needle_len <= haystack_len)
 	{
-		// Load an xmm register with 16 unaligned bytes.  SSE3, L/Th: 1/0.25-0.5, plus cache effects.
-		// "This intrinsic may perform better than _mm_loadu_si128 when the data crosses a cache line boundary."
-		__m128i xmm0 = _mm_lddqu_si128((const __m128i *)(cbegin+i));
-
-		assume(m_end_ranges_table <= 256);
-
-		for(j=0; j < (m_end_ranges_table & vec_size_mask); j+=vec_size_bytes)
+		// Compare each position against the needle's two rarest bytes, as the wide LiteralMatch()es do, and only do
+		// the full compare where both match.  This beats memmem_short_pattern()'s first-byte prefilter and pcmpestri
+		// even on short needles, since a needle's first byte is often one of the most common in the file.
+		const size_t rare0 = m_literal_rare_offset[0];
+		const size_t rare1 = m_literal_rare_offset[1];
+		const __m128i rare0_byte = _mm_set1_epi8(needle[rare0]);
+		const __m128i rare1_byte = _mm_set1_epi8(needle[rare1]);
+
+		// @note The loads at the rare bytes' offsets may run up to a vector's worth past the end of the data, into its padding.
+		for(size_t i=0; i + needle_len <= haystack_len && str_match == nullptr; i+=f_alignment)
 		{
-			// Load one of our range strings, which are 16-byte aligned.
-			__m128i xmm1_ranges = _mm_load_si128((__m128i*)(m_compiled_range_bitmap+j));
-			// Do the search for values in the specified ranges.
-			int len_a = ((len-i)>vec_size_bytes) ? vec_size_bytes : (len-i);
-			int lsb_set = _mm_cmpestri(xmm1_ranges, vec_size_bytes, xmm0, len_a,
-					_SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_LEAST_SIGNIFICANT);
-
-			if(lsb_set < 16)
-			{
-				return std::min(cbegin + i + lsb_set, cbegin + len);
-			}
-		}
+			__m128i rare0_block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(haystack+i+rare0));
+			__m128i rare1_block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(haystack+i+rare1));
+			uint32_t candidates = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(rare0_block, rare0_byte), _mm_cmpeq_epi8(rare1_block, rare1_byte)));
 
-		if(j < m_end_ranges_table)
-		{
-			// One partial xmm compare-to register to handle.
-			// Load the last partial compare-to string.
-			__m128i xmm1_ranges = _mm_load_si128((__m128i*)(m_compiled_range_bitmap+j));
-			// Do the search for values in the specified ranges.
-			int len_a = ((len-i)>vec_size_bytes) ? vec_size_bytes : (len-i);
-			int lsb_set = _mm_cmpestri(xmm1_ranges, m_end_ranges_table & (vec_size_bytes-1), xmm0, len_a,
-					_SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_LEAST_SIGNIFICANT);
-
-			if(lsb_set < 16)
+			while(candidates != 0)
 			{
-				return std::min(cbegin + i + lsb_set, cbegin + len);
+				size_t pos = i + find_first_set_bit(candidates) - 1;
+				if(pos + needle_len > haystack_len)
+				{
+					// This and any later candidates would run off the end.
+					break;
+				}
+				if(std::memcmp(haystack + pos, needle, needle_len) == 0)
+				{
+					str_match = haystack + pos;
+					break;
+				}
+				// Clear the lowest set bit.
+				candidates &= candidates - 1;
 			}
-
 		}
 	}
-	return cbegin+len;
-}
-
-
-int FileScanner::LiteralMatch_sse4_2(const char *file_data, size_t file_size, size_t start_offset, size_t *ovector) const noexcept
-{
-	int rc = 0;
-	const char* str_match;
-	const size_t bytes_to_search = file_size - start_offset;
 
-	if((m_literal_search_string_len <= 16) && (m_literal_search_string_len>=1))	// Current sse4.2 memmem_short_pattern()
-																				// only works for search strings with 1 <= len < 17.
+	if(str_match == nullptr)
 	{
-		str_match = (const char*)MV_USE(memmem_short_pattern, ISA_x86_64::SSE4_2)((const void*)(file_data+start_offset), bytes_to_search,
-				(const void *)m_literal_search_string.get(), m_literal_search_string_len);
+		// No match.
+		ovector[0] = file_size;
+		ovector[1] = file_size;
+		return -1; /// @note Both PCRE_ERROR_NOMATCH and PCRE2_ERROR_NOMATCH are both -1.
 	}
-	else
+
+	// Found a match.
+	ovector[0] = str_match - file_data;
+	ovector[1] = ovector[0] + needle_len;
+	return 1;
+}
+
+int FileScanner::LiteralMatchCaseless_sse4_2(const char *file_data, size_t file_size, size_t start_offset, size_t *ovector) const noexcept
+{
+	const char * __restrict__ haystack = file_data + start_offset;
+	const size_t haystack_len = file_size - start_offset;
+	// Already lowercased by AnalyzeRegex().
+	const char * __restrict__ needle = reinterpret_cast<const char *>(m_literal_search_string.get());
+	const size_t needle_len = m_literal_search_string_len;
+	const char *str_match = nullptr;
+
+	// Lowercase 16 bytes at a time.  No unsigned byte compares until AVX-512, but x <= n iff min(x, n) == x.
+	const __m128i upper_A = _mm_set1_epi8('A');
+	const __m128i upper_span = _mm_set1_epi8('Z'-'A');
+	const __m128i case_bit = _mm_set1_epi8(0x20);
+	auto tolower_16 = [&](__m128i a) -> __m128i {
+		__m128i offset = _mm_sub_epi8(a, upper_A);
+		__m128i is_upper = _mm_cmpeq_epi8(_mm_min_epu8(offset, upper_span), offset);
+		return _mm_or_si128(a, _mm_and_si128(is_upper, case_bit));
+	};
+
+	if(needle_len >= 1 && needle_len <= haystack_len)
 	{
-		str_match = (const char*)memmem((const void*)(file_data+start_offset), bytes_to_search,
-								(const void *)m_literal_search_string.get(), m_literal_search_string_len);
+		// Compare each position against the needle's two rarest bytes, as the wide LiteralMatch()es do.
+		const size_t rare0 = m_literal_rare_offset[0];
+		const size_t rare1 = m_literal_rare_offset[1];
+		const __m128i rare0_byte = _mm_set1_epi8(needle[rare0]);
+		const __m128i rare1_byte = _mm_set1_epi8(needle[rare1]);
+
+		// @note The loads at the rare bytes' offsets may run up to a vector's worth past the end of the data, into its padding.
+		for(size_t i=0; i + needle_len <= haystack_len && str_match == nullptr; i+=f_alignment)
+		{
+			__m128i rare0_block = tolower_16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(haystack+i+rare0)));
+			__m128i rare1_block = tolower_16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(haystack+i+rare1)));
+			uint32_t candidates = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(rare0_block, rare0_byte), _mm_cmpeq_epi8(rare1_block, rare1_byte)));
+
+			while(candidates != 0)
+			{
+				size_t pos = i + find_first_set_bit(candidates) - 1;
+				if(pos + needle_len > haystack_len)
+				{
+					break;
+				}
+				if(ascii_caseless_equal(haystack + pos, needle, needle_len))
+				{
+					str_match = haystack + pos;
+					break;
+				}
+				candidates &= candidates - 1;
+			}
+		}
 	}
 
 	if(str_match == nullptr)
 	{
 		// No match.
-		rc = -1; /// @note Both PCRE_ERROR_NOMATCH and PCRE2_ERROR_NOMATCH are both -1.
 		ovector[0] = file_size;
 		ovector[1] = file_size;
-	}
-	else
-	{
-		// Found a match.
-		rc = 1;
-		ovector[0] = str_match - file_data;
-		ovector[1] = ovector[0] + m_literal_search_string_len;
+		return -1; /// @note Both PCRE_ERROR_NOMATCH and PCRE2_ERROR_NOMATCH are both -1.
 	}
 
-	return rc;
+	// Found a match.
+	ovector[0] = str_match - file_data;
+	ovector[1] = ovector[0] + needle_len;
+	return 1;
 }
 
 #if KEEP_AS_EXAMPLE
@@ -413,3 +814,5 @@ static inline auto FileScanner::FindFirstPossibleCodeUnit(const char * __restric
 #endif // __POPCNT__
 
 #endif
+
+#endif // !__AVX2__
@@ -39,6 +39,7 @@ Globber::Globber(std::vector<std::string> start_paths,
 		bool recurse_subdirs,
 		bool follow_symlinks,
 		int dirjobs,
+		FileReadOrder read_order,
 		sync_queue<std::shared_ptr<FileID>>& out_queue)
 		: m_start_paths(start_paths),
 		  m_type_manager(type_manager),
@@ -46,6 +47,7 @@ Globber::Globber(std::vector<std::string> start_paths,
 		  m_recurse_subdirs(recurse_subdirs),
 		  m_follow_symlinks(follow_symlinks),
 		  m_dirjobs(dirjobs),
+		  m_read_order(read_order),
 		  m_out_queue(out_queue)
 {
 
@@ -56,7 +58,7 @@ void Globber::Run()
 	auto file_basename_filter = [this](const std::string &basename) noexcept { return m_type_manager.FileShouldBeScanned(basename); };
 	auto dir_basename_filter = [this](const std::string &basename) noexcept { return m_dir_inc_manager.DirShouldBeExcluded(basename); };
 
-	DirTree dt(m_out_queue, file_basename_filter, dir_basename_filter, m_recurse_subdirs, m_follow_symlinks);
+	DirTree dt(m_out_queue, file_basename_filter, dir_basename_filter, m_recurse_subdirs, m_follow_symlinks, m_read_order);
 
 	dt.Scandir(m_start_paths, m_dirjobs);
 }
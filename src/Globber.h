@@ -44,6 +44,7 @@ public:
 			bool recurse_subdirs,
 			bool follow_symlinks,
 			int dirjobs,
+			FileReadOrder read_order,
 			sync_queue<std::shared_ptr<FileID>> &out_queue);
 	~Globber() = default;
 
@@ -66,6 +67,9 @@ private:
 
 	int m_dirjobs;
 
+	/// Order in which each directory's files are handed to the scanners.
+	FileReadOrder m_read_order;
+
 	sync_queue<std::shared_ptr<FileID>>& m_out_queue;
 };
 
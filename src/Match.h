@@ -52,6 +52,8 @@ public:
 
 	/// @note Data members not private, this is more of a struct than a class.
 	size_t m_line_number { 0 };
+	/// The 1-based number of the pattern this matched, when searching for several at once.  0 if not reported.
+	size_t m_pattern_number { 0 };
 	std::string m_pre_match;
 	std::string m_match;
 	std::string m_post_match;
@@ -36,10 +36,36 @@ void MatchList::AddMatch(Match &&match)
 	m_match_list.push_back(std::move(match));
 }
 
+void MatchList::Append(MatchList &&other, size_t line_number_offset)
+{
+	m_match_list.reserve(m_match_list.size() + other.m_match_list.size());
+	for(Match &m : other.m_match_list)
+	{
+		m.m_line_number += line_number_offset;
+		m_match_list.push_back(std::move(m));
+	}
+	other.m_match_list.clear();
+	m_file_matched = m_file_matched || other.m_file_matched;
+	other.m_file_matched = false;
+	m_num_unmatched_lines += other.m_num_unmatched_lines;
+	other.m_num_unmatched_lines = 0;
+}
+
 void MatchList::clear() noexcept
 {
 	m_filename.clear();
 	m_match_list.clear();
+	m_file_matched = false;
+	m_num_unmatched_lines = 0;
+}
+
+/// Print "#N:", where N is the number of the pattern @a match matched, if it has one.
+static void AppendPatternNumber(std::ostream &sstrm, const Match &match, const std::string &color_number, const std::string &color_default)
+{
+	if(match.m_pattern_number != 0)
+	{
+		sstrm << color_number << '#' << match.m_pattern_number << color_default << ':';
+	}
 }
 
 void MatchList::Print(std::ostream &sstrm, OutputContext &output_context) const
@@ -75,6 +101,17 @@ void MatchList::Print(std::ostream &sstrm, OutputContext &output_context) const
 	std::string composition_buffer;
 	composition_buffer.reserve(256);
 
+	if(output_context.is_filename_only_enabled())
+	{
+		// Only the filename gets printed, TTY or not.
+		if(color) composition_buffer += *color_filename;
+		composition_buffer += no_dotslash_fn;
+		if(color) composition_buffer += *color_default;
+		composition_buffer += '\n';
+		sstrm << composition_buffer;
+		return;
+	}
+
 	// The only real difference between TTY vs. non-TTY printing here is that for TTY we print:
 	//   filename
 	//   lineno:column:match
@@ -106,6 +143,7 @@ void MatchList::Print(std::ostream &sstrm, OutputContext &output_context) const
 			{
 				sstrm << it.m_pre_match.length()+1 << ':';
 			}
+			AppendPatternNumber(sstrm, it, *color_lineno, *color_default);
 			composition_buffer.clear();
 			composition_buffer += it.m_pre_match;
 			if(color) composition_buffer += *color_match;
@@ -143,6 +181,9 @@ void MatchList::Print(std::ostream &sstrm, OutputContext &output_context) const
 				sstrm << it.m_pre_match.length()+1 << ':';
 			}
 
+			// Which pattern matched, if we were searching for several.
+			AppendPatternNumber(sstrm, it, *color_lineno, *color_default);
+
 			// The match text.
 			composition_buffer.clear();
 			composition_buffer += it.m_pre_match;
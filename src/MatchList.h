@@ -59,13 +59,29 @@ public:
 	/// Add a match to this MatchList.  Note that this is done by moving, not copying, the given %match.
 	void AddMatch(Match &&match);
 
+	/**
+	 * Move all the Matches in @a other to the end of this MatchList, adding @a line_number_offset to their line numbers.
+	 * Used to stitch together the results of scanning a file in separate pieces, where each piece's line numbers
+	 * start from 1.
+	 */
+	void Append(MatchList &&other, size_t line_number_offset);
+
+	/// Record that the file matched, without adding any Matches.  Used when only the names of matching files are wanted.
+	void SetFileMatched() noexcept { m_file_matched = true; };
+
+	/// Record that a line of the file couldn't be matched at all, so the Matches in this MatchList may not be all there are.
+	void AddUnmatchedLine() noexcept { ++m_num_unmatched_lines; };
+
+	/// Returns the number of lines AddUnmatchedLine() has been called for.
+	[[nodiscard]] size_t GetNumberOfUnmatchedLines() const noexcept { return m_num_unmatched_lines; };
+
 	void Print(std::ostream &sstrm, OutputContext &output_context) const;
 
 	/// Returns a bool indicating whether the MatchList is empty.
 	/// @note You might expect that this needs to indicate 'empty' after a move-from has occurred.
 	/// That's not the case.  A moved-from object only has to be destructible, and the move and copy operations
 	/// have to still work the same as they did before the move operation.
-	[[nodiscard]] bool empty() const noexcept { return m_match_list.empty(); };
+	[[nodiscard]] bool empty() const noexcept { return m_match_list.empty() && !m_file_matched; };
 
 	void clear() noexcept;
 
@@ -78,6 +94,12 @@ private:
 
 	/// The Matches found in this file.
 	std::vector<Match> m_match_list;
+
+	/// true if SetFileMatched() has been called.
+	bool m_file_matched {false};
+
+	/// Number of lines which couldn't be matched.
+	size_t m_num_unmatched_lines {0};
 };
 
 // Require MatchList to be nothrow move constructible so that a container of them can use move on reallocation.
@@ -0,0 +1,231 @@
+/*
+ * Copyright 2022 Gary R. Van Sickle (grvs@users.sourceforge.net).
+ *
+ * This file is part of UniversalCodeGrep.
+ *
+ * UniversalCodeGrep is free software: you can redistribute it and/or modify it under the
+ * terms of version 3 of the GNU General Public License as published by the Free
+ * Software Foundation.
+ *
+ * UniversalCodeGrep is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * UniversalCodeGrep.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file */
+
+#include <config.h>
+
+#include "MultiLiteralMatcher.h"
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <limits>
+
+#include <libext/Logger.h>
+#include <libext/string.hpp>
+
+/// Marker for a trie edge which doesn't exist yet.
+static constexpr uint32_t f_no_edge = std::numeric_limits<uint32_t>::max();
+
+MultiLiteralMatcher::MultiLiteralMatcher(std::vector<std::string> literals, bool build_dfa, bool ignore_case)
+	: m_literals(std::move(literals)), m_ignore_case(ignore_case)
+{
+	m_min_len = std::numeric_limits<size_t>::max();
+	for(auto & lit : m_literals)
+	{
+		if(m_ignore_case)
+		{
+			std::transform(lit.begin(), lit.end(), lit.begin(), ascii_tolower);
+		}
+		m_min_len = std::min(m_min_len, lit.size());
+		m_max_len = std::max(m_max_len, lit.size());
+	}
+
+	if(build_dfa)
+	{
+		BuildDFA();
+	}
+}
+
+void MultiLiteralMatcher::BuildDFA()
+{
+	// Build the trie.  Literals with common prefixes share nodes, so it can be much smaller than the literals' total
+	// length; all that matters is whether it fits.
+	m_transitions.assign(256, f_no_edge);
+	m_match_len.assign(1, 0);
+	for(const auto & lit : m_literals)
+	{
+		uint32_t state = 0;
+		for(auto c : lit)
+		{
+			uint32_t & next = m_transitions[state*256 + static_cast<uint8_t>(c)];
+			if(next == f_no_edge)
+			{
+				if(m_match_len.size() == f_max_dfa_states)
+				{
+					// Too big.  Leave the DFA unbuilt.
+					LOG(INFO) << "Multi-literal trie needs more than " << f_max_dfa_states << " states, not building DFA.";
+					std::vector<uint32_t>().swap(m_transitions);
+					std::vector<uint32_t>().swap(m_match_len);
+					return;
+				}
+				next = m_match_len.size();
+				m_transitions.resize(m_transitions.size()+256, f_no_edge);
+				m_match_len.push_back(0);
+				// m_transitions may have been reallocated, don't use next after this.
+				state = m_match_len.size()-1;
+			}
+			else
+			{
+				state = next;
+			}
+		}
+		m_match_len[state] = lit.size();
+	}
+
+	// Breadth-first, compute the failure links and fill in the missing transitions with the transitions of the failure
+	// state, converting the trie into a DFA.
+	std::vector<uint32_t> fail(m_match_len.size(), 0);
+	std::deque<uint32_t> queue;
+	for(uint16_t c = 0; c < 256; ++c)
+	{
+		uint32_t & next = m_transitions[c];
+		if(next == f_no_edge)
+		{
+			next = 0;
+		}
+		else
+		{
+			fail[next] = 0;
+			queue.push_back(next);
+		}
+	}
+	while(!queue.empty())
+	{
+		uint32_t state = queue.front();
+		queue.pop_front();
+
+		// The literal ending at this state is always longer than any ending at its failure state.
+		if(m_match_len[state] == 0)
+		{
+			m_match_len[state] = m_match_len[fail[state]];
+		}
+
+		for(uint16_t c = 0; c < 256; ++c)
+		{
+			uint32_t & next = m_transitions[state*256 + c];
+			uint32_t fail_next = m_transitions[fail[state]*256 + c];
+			if(next == f_no_edge)
+			{
+				next = fail_next;
+			}
+			else
+			{
+				fail[next] = fail_next;
+				queue.push_back(next);
+			}
+		}
+	}
+
+	if(m_ignore_case)
+	{
+		// The trie only has the lowercase letters.  Uppercase ones go wherever their lowercase ones do.
+		for(size_t state = 0; state < m_match_len.size(); ++state)
+		{
+			for(char c = 'A'; c <= 'Z'; ++c)
+			{
+				m_transitions[state*256 + static_cast<uint8_t>(c)] = m_transitions[state*256 + static_cast<uint8_t>(ascii_tolower(c))];
+			}
+		}
+	}
+
+	LOG(INFO) << "Built multi-literal DFA with " << m_match_len.size() << " states.";
+}
+
+const char * MultiLiteralMatcher::Find(const char * __restrict__ cbegin, const char * __restrict__ cend, size_t *match_len) const noexcept
+{
+	const uint32_t * __restrict__ transitions = m_transitions.data();
+	const uint32_t * __restrict__ accepting_len = m_match_len.data();
+	uint32_t state = 0;
+	const char *leftmost = nullptr;
+
+	for(const char *p = cbegin; p < cend; ++p)
+	{
+		state = transitions[state*256 + static_cast<uint8_t>(*p)];
+		if(accepting_len[state] != 0)
+		{
+			// Found a match ending here.  Since matches are found in order of their ends, not their starts, we can't
+			// stop yet: a longer literal starting earlier could still be found.
+			const char *start = p + 1 - accepting_len[state];
+			if(leftmost == nullptr || start < leftmost)
+			{
+				leftmost = start;
+			}
+		}
+		if(leftmost != nullptr && p + 1 >= leftmost + m_max_len)
+		{
+			// Any match which ends after this point must start after leftmost.
+			break;
+		}
+	}
+
+	if(leftmost != nullptr)
+	{
+		// Pick the literal which comes first in the alternation, which isn't necessarily the longest.
+		*match_len = MatchAt(leftmost, cend);
+	}
+
+	return leftmost;
+}
+
+size_t MultiLiteralMatcher::MatchAt(const char * __restrict__ pos, const char * __restrict__ cend) const noexcept
+{
+	const size_t remaining = cend - pos;
+
+	if(remaining < m_min_len)
+	{
+		return 0;
+	}
+
+	if(m_ignore_case)
+	{
+		const char first = ascii_tolower(*pos);
+		for(const auto & lit : m_literals)
+		{
+			if(lit.size() <= remaining && lit[0] == first && ascii_caseless_equal(pos, lit.data(), lit.size()))
+			{
+				return lit.size();
+			}
+		}
+		return 0;
+	}
+
+	for(const auto & lit : m_literals)
+	{
+		if(lit.size() <= remaining && lit[0] == *pos && std::memcmp(lit.data(), pos, lit.size()) == 0)
+		{
+			return lit.size();
+		}
+	}
+
+	return 0;
+}
+
+size_t MultiLiteralMatcher::IndexOf(const char * __restrict__ str, size_t len) const noexcept
+{
+	for(size_t i = 0; i < m_literals.size(); ++i)
+	{
+		if(m_literals[i].size() == len && (m_ignore_case ? ascii_caseless_equal(str, m_literals[i].data(), len)
+				: std::memcmp(m_literals[i].data(), str, len) == 0))
+		{
+			return i;
+		}
+	}
+
+	return m_literals.size();
+}
@@ -0,0 +1,113 @@
+/*
+ * Copyright 2022 Gary R. Van Sickle (grvs@users.sourceforge.net).
+ *
+ * This file is part of UniversalCodeGrep.
+ *
+ * UniversalCodeGrep is free software: you can redistribute it and/or modify it under the
+ * terms of version 3 of the GNU General Public License as published by the Free
+ * Software Foundation.
+ *
+ * UniversalCodeGrep is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * UniversalCodeGrep.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file MultiLiteralMatcher.h */
+
+#ifndef SRC_MULTILITERALMATCHER_H_
+#define SRC_MULTILITERALMATCHER_H_
+
+#include <config.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Matcher for a set of literal strings, e.g. the alternatives of a regex like 'TODO|FIXME|XXX'.
+ *
+ * Matches are found with the same leftmost-first semantics a backtracking regex engine would give the equivalent
+ * alternation: the match is the one which starts earliest in the subject, and of the literals which match at that
+ * position, the one which comes first in the alternation wins.
+ *
+ * Two search strategies are provided:
+ * - MatchAt() checks all literals at a single position.  This is for small sets, where the caller has a fast
+ *   (vectorized) way of finding the next position where any of the literals' first chars occurs.
+ * - Find() is an Aho-Corasick automaton compiled to a full DFA, for sets too large for the above to pay off.
+ */
+class MultiLiteralMatcher
+{
+public:
+	/**
+	 * Constructs the matcher.  Literals must be non-empty.
+	 *
+	 * @param literals  The literals to match, in alternation order.
+	 * @param build_dfa  If true, build the Aho-Corasick DFA needed by Find(), unless it would need more than
+	 *                   f_max_dfa_states states.  Check GetNumDFAStates() to see whether it was.
+	 * @param ignore_case  If true, match the literals ignoring ASCII case, the same as libpcre2 does without UTF.
+	 */
+	explicit MultiLiteralMatcher(std::vector<std::string> literals, bool build_dfa, bool ignore_case = false);
+	~MultiLiteralMatcher() = default;
+
+	/**
+	 * Find the leftmost-first match of any of the literals in [@a cbegin, @a cend).
+	 *
+	 * @param cbegin
+	 * @param cend
+	 * @param match_len  Set to the length of the match if one was found.
+	 * @return  Pointer to the start of the match, or nullptr if there wasn't one.
+	 */
+	const char * Find(const char * __restrict__ cbegin, const char * __restrict__ cend, size_t *match_len) const noexcept;
+
+	/**
+	 * Check whether any of the literals match starting at @a pos.
+	 *
+	 * @return  The length of the first literal in alternation order which matches at @a pos, or 0 if none do.
+	 */
+	size_t MatchAt(const char * __restrict__ pos, const char * __restrict__ cend) const noexcept;
+
+	/**
+	 * Find which literal [@a str, @a str+@a len) is.
+	 *
+	 * @return  The index of the first literal in alternation order equal to it, or size() if none are.
+	 */
+	size_t IndexOf(const char * __restrict__ str, size_t len) const noexcept;
+
+	/// Number of literals in the set.
+	size_t size() const noexcept { return m_literals.size(); };
+
+	/// Number of states in the DFA, or 0 if it wasn't built.
+	size_t GetNumDFAStates() const noexcept { return m_match_len.size(); };
+
+	/// Upper limit on the number of DFA states we'll build.  The transition table is 1KB per state.
+	static constexpr size_t f_max_dfa_states = 16*1024;
+
+private:
+
+	/// Build the DFA, or leave m_transitions and m_match_len empty if it would be too big.
+	void BuildDFA();
+
+	/// The literals, in alternation order.  Lowercased if m_ignore_case.
+	std::vector<std::string> m_literals;
+
+	/// Whether we're ignoring ASCII case.
+	bool m_ignore_case {false};
+
+	/// Length of the shortest and longest literals.
+	size_t m_min_len {0};
+	size_t m_max_len {0};
+
+	/// The DFA's transition table, 256 entries per state.  State 0 is the start state.
+	std::vector<uint32_t> m_transitions;
+
+	/**
+	 * For each DFA state, the length of the longest literal which ends at that state, or 0 if it isn't an accepting state.
+	 * The longest one is the one which started earliest.
+	 */
+	std::vector<uint32_t> m_match_len;
+};
+
+#endif /* SRC_MULTILITERALMATCHER_H_ */
@@ -21,8 +21,9 @@
 
 #include "OutputContext.h"
 
-OutputContext::OutputContext(bool output_is_tty, bool enable_color, bool print_column)
-	: m_output_is_tty(output_is_tty), m_enable_color(enable_color), m_print_column(print_column)
+OutputContext::OutputContext(bool output_is_tty, bool enable_color, bool print_column, bool print_filename_only)
+	: m_output_is_tty(output_is_tty), m_enable_color(enable_color), m_print_column(print_column),
+	  m_print_filename_only(print_filename_only)
 {
 	if(m_enable_color)
 	{
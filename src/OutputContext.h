@@ -30,12 +30,13 @@
 class OutputContext
 {
 public:
-	OutputContext(bool output_is_tty, bool enable_color, bool print_column);
+	OutputContext(bool output_is_tty, bool enable_color, bool print_column, bool print_filename_only);
 	~OutputContext();
 
 	[[nodiscard]] inline bool is_output_tty() const noexcept { return m_output_is_tty; };
 	[[nodiscard]] inline bool is_color_enabled() const noexcept { return m_enable_color; };
 	[[nodiscard]] inline bool is_column_print_enabled() const noexcept { return m_print_column; };
+	[[nodiscard]] inline bool is_filename_only_enabled() const noexcept { return m_print_filename_only; };
 
 	/// @name Active colors.
 	/// @{
@@ -55,6 +56,9 @@ private:
 	/// Whether to print the column number of the first match or not.
 	bool m_print_column;
 
+	/// Whether to print only the filename of each file, and none of the matches.
+	bool m_print_filename_only;
+
 	/// @name Default output colors.
 	/// @{
 	// ANSI SGR parameter setting sequences for setting the color and boldness of the output text.
@@ -31,7 +31,7 @@
 #include <libext/Logger.h>
 
 
-OutputTask::OutputTask(bool flag_color, bool flag_nocolor, bool flag_column, sync_queue<MatchList> &input_queue)
+OutputTask::OutputTask(bool flag_color, bool flag_nocolor, bool flag_column, bool flag_filename_only, sync_queue<MatchList> &input_queue)
 	: m_input_queue(input_queue)
 {
 	// Determine if the output is going to a terminal.  If so we'll use color by default, group the matches under
@@ -51,8 +51,9 @@ OutputTask::OutputTask(bool flag_color, bool flag_nocolor, bool flag_column, syn
 	}
 
 	m_print_column = flag_column;
+	m_print_filename_only = flag_filename_only;
 
-	m_output_context.reset(new OutputContext(m_output_is_tty, m_enable_color, m_print_column));
+	m_output_context.reset(new OutputContext(m_output_is_tty, m_enable_color, m_print_column, m_print_filename_only));
 }
 
 OutputTask::~OutputTask()
@@ -69,7 +70,7 @@ void OutputTask::Run()
 
 	while(m_input_queue.pull_front(std::move(ml)) != queue_op_status::closed)
 	{
-		if(first_matchlist_printed && m_output_is_tty)
+		if(first_matchlist_printed && m_output_is_tty && !m_print_filename_only)
 		{
 			// Print a blank line between the match lists (i.e. the groups of matches in one file).
 			std::cout << '\n';
@@ -81,8 +82,9 @@ void OutputTask::Run()
 		sstrm.clear();
 		first_matchlist_printed = true;
 
-		// Count up the total number of matches.
-		m_total_matched_lines += ml.GetNumberOfMatchedLines();
+		// Count up the total number of matches.  In filename-only mode, the MatchLists don't hold the matches,
+		// and files are listed whether they matched or not, so count each file as one.
+		m_total_matched_lines += m_print_filename_only ? 1 : ml.GetNumberOfMatchedLines();
 	}
 }
 
@@ -35,11 +35,12 @@
 class OutputTask
 {
 public:
-	OutputTask(bool flag_color, bool flag_nocolor, bool flag_column, sync_queue<MatchList> &input_queue);
+	OutputTask(bool flag_color, bool flag_nocolor, bool flag_column, bool flag_filename_only, sync_queue<MatchList> &input_queue);
 	virtual ~OutputTask();
 
 	void Run();
 
+	/// Returns the total number of matched lines, or in filename-only mode, the number of files listed.
 	[[nodiscard]] long long GetTotalMatchedLines() const { return m_total_matched_lines; };
 
 private:
@@ -56,6 +57,9 @@ private:
 	/// Whether to print the column number of the first match or not.
 	bool m_print_column;
 
+	/// Whether to print only the filename of each incoming MatchList.
+	bool m_print_filename_only;
+
 	std::unique_ptr<OutputContext> m_output_context;
 
 	/// The total number of matched lines as reported by the incoming MatchLists.
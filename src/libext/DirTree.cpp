@@ -37,6 +37,12 @@
 #include <future/memory.hpp>
 #include <libext/filesystem.hpp> // For AT_FDCWD, AT_NO_AUTOMOUNT, openat(), etc.
 
+#if HAVE_LINUX_FIEMAP_H
+#include <sys/ioctl.h>
+#include <linux/fs.h> // For FS_IOC_FIEMAP.
+#include <linux/fiemap.h>
+#endif
+
 /// Estimate that we'll traverse no more than 10000 directories in one traversal.
 /// m_dir_has_been_visited will resize/rehash if it needs more space.
 constexpr auto M_INITIAL_NUM_DIR_ESTIMATE = 10000;
@@ -45,8 +51,9 @@ DirTree::DirTree(sync_queue<std::shared_ptr<FileID>>& output_queue,
 		const file_basename_filter_type &file_basename_filter,
 		const dir_basename_filter_type &dir_basename_filter,
 		bool recurse,
-		bool follow_symlinks)
-	: m_recurse(recurse), m_follow_symlinks(follow_symlinks), m_out_queue(output_queue),
+		bool follow_symlinks,
+		FileReadOrder read_order)
+	: m_recurse(recurse), m_follow_symlinks(follow_symlinks), m_read_order(read_order), m_out_queue(output_queue),
 	  m_file_basename_filter(file_basename_filter), m_dir_basename_filter(dir_basename_filter)
 {
 	m_dir_has_been_visited.reserve(M_INITIAL_NUM_DIR_ESTIMATE);
@@ -190,6 +197,10 @@ void DirTree::ReaddirLoop(int dirjob_num)
 
 		if(!local_file_queue.empty())
 		{
+			if(m_read_order != FRO_READDIR && local_file_queue.size() > 1)
+			{
+				OrderFileBatch(dirfd(d), &local_file_queue, stats);
+			}
 			m_out_queue.push_back(local_file_queue);
 		}
 
@@ -364,3 +375,108 @@ void DirTree::ProcessDirent(const std::shared_ptr<FileID>& dse, struct dirent* c
 		}
 	}
 }
+
+#if HAVE_LINUX_FIEMAP_H
+/**
+ * Get the physical location on disk of the first extent of file @a basename in directory @a dir_fd.
+ *
+ * @param dir_fd
+ * @param basename
+ * @param physical  Out: The physical byte offset of the first extent, or 0 if the file has no extents (e.g. it's empty).
+ * @returns  true on success, false if the filesystem doesn't support FIEMAP or the file couldn't be opened.
+ */
+static bool GetFirstPhysicalExtent(int dir_fd, const std::string &basename, uint64_t *physical) noexcept
+{
+	int fd = openat(dir_fd, basename.c_str(), O_RDONLY | O_NOCTTY | O_NOATIME);
+	if(fd == -1 && errno == EPERM)
+	{
+		// O_NOATIME is only allowed on files we own.
+		fd = openat(dir_fd, basename.c_str(), O_RDONLY | O_NOCTTY);
+	}
+	if(fd == -1)
+	{
+		return false;
+	}
+
+	// Room for the fiemap header plus exactly one extent.
+	alignas(struct fiemap) char buffer[sizeof(struct fiemap) + sizeof(struct fiemap_extent)] {};
+	auto fm = reinterpret_cast<struct fiemap *>(buffer);
+	fm->fm_start = 0;
+	fm->fm_length = FIEMAP_MAX_OFFSET;
+	fm->fm_extent_count = 1;
+
+	int retval = ioctl(fd, FS_IOC_FIEMAP, fm);
+	close(fd);
+	if(retval == -1)
+	{
+		return false;
+	}
+
+	*physical = (fm->fm_mapped_extents > 0) ? fm->fm_extents[0].fe_physical : 0;
+	return true;
+}
+#endif
+
+void DirTree::OrderFileBatch(int dir_fd, std::deque<std::shared_ptr<FileID>> *local_file_queue, DirTraversalStats &stats)
+{
+	std::vector<uint64_t> keys;
+	keys.reserve(local_file_queue->size());
+
+	bool have_extents = false;
+
+#if HAVE_LINUX_FIEMAP_H
+	if(m_read_order == FRO_EXTENT)
+	{
+		have_extents = true;
+		for(const auto& fid : *local_file_queue)
+		{
+			uint64_t physical;
+			if(!GetFirstPhysicalExtent(dir_fd, fid->GetBasename(), &physical))
+			{
+				// No FIEMAP support here (e.g. tmpfs, NFS), fall back to inode order for this directory.
+				LOG(INFO) << "FIEMAP failed on '" << fid->GetBasename() << "': " << LOG_STRERROR() << ", ordering by inode";
+				have_extents = false;
+				keys.clear();
+				break;
+			}
+			keys.push_back(physical);
+		}
+	}
+#else
+	(void)dir_fd;
+#endif
+
+	if(!have_extents)
+	{
+		// The FileIDs already have their inode numbers from the dirents, so this doesn't need any stat()s.
+		for(const auto& fid : *local_file_queue)
+		{
+			keys.push_back(fid->GetUniqueFileIdentifier().ino());
+		}
+	}
+
+	std::vector<std::pair<uint64_t, std::shared_ptr<FileID>>> keyed_files;
+	keyed_files.reserve(keys.size());
+	for(size_t i = 0; i < keys.size(); ++i)
+	{
+		keyed_files.emplace_back(keys[i], std::move((*local_file_queue)[i]));
+	}
+
+	std::stable_sort(keyed_files.begin(), keyed_files.end(),
+			[](const auto& a, const auto& b){ return a.first < b.first; });
+
+	local_file_queue->clear();
+	for(auto& kf : keyed_files)
+	{
+		local_file_queue->push_back(std::move(kf.second));
+	}
+
+	if(have_extents)
+	{
+		stats.m_num_batches_ordered_by_extent++;
+	}
+	else
+	{
+		stats.m_num_batches_ordered_by_inode++;
+	}
+}
@@ -52,6 +52,11 @@ class DirTraversalStats
 	X("Number of files found", m_num_files_found) \
 	X("Number of files rejected", m_num_files_rejected) \
 	X("Number of files sent for scanning", m_num_files_scanned) \
+	X("Number of directories' files ordered by inode", m_num_batches_ordered_by_inode) \
+	X("Number of directories' files ordered by physical extent", m_num_batches_ordered_by_extent) \
+	X("Number of files rejected by pre-admission as too large", m_num_files_rejected_too_large) \
+	X("Number of files rejected by pre-admission as binary", m_num_files_rejected_binary) \
+	X("Number of files rejected by pre-admission as minified", m_num_files_rejected_minified) \
 	X("Number of files which required a stat() call to determine type", m_num_filetype_stats) \
 	X("Number of files which did not require a stat() call to determine type", m_num_filetype_without_stat)
 
@@ -114,7 +119,8 @@ public:
 			const file_basename_filter_type &file_basename_filter,
 			const dir_basename_filter_type &dir_basename_filter,
 			bool recurse,
-			bool follow_symlinks);
+			bool follow_symlinks,
+			FileReadOrder read_order = FRO_READDIR);
 	~DirTree() = default;
 
 	/**
@@ -135,6 +141,9 @@ private:
 
 	int m_dirjobs {4};
 
+	/// Order in which we push each directory's files onto #m_out_queue.
+	FileReadOrder m_read_order { FRO_READDIR };
+
 	/// Directory queue.  Used internally.
 	sync_queue<std::shared_ptr<FileID>> m_dir_queue;
 
@@ -167,6 +176,16 @@ private:
 	void ProcessDirent(const std::shared_ptr<FileID>& dse, struct dirent *de, DirTraversalStats &stats,
 			std::deque<std::shared_ptr<FileID>> *local_file_queue);
 
+	/**
+	 * Sort the files found in one directory into #m_read_order, so that the scanner threads read them in an order
+	 * which minimizes seeking on rotating and network storage.
+	 *
+	 * @param dir_fd            File descriptor of the directory the files are in.
+	 * @param local_file_queue  The files to sort.
+	 * @param stats             Stats to update.
+	 */
+	void OrderFileBatch(int dir_fd, std::deque<std::shared_ptr<FileID>> *local_file_queue, DirTraversalStats &stats);
+
 };
 
 #endif /* SRC_LIBEXT_DIRTREE_H_ */
@@ -21,17 +21,120 @@
 
 #include "FileDescriptorCache.h"
 
-#include "filesystem.hpp"
+#include <ostream>
 
+#include <unistd.h> // For close().
 
-FileDescriptorCache::FileDescriptorCache()
-{
-	// TODO Auto-generated constructor stub
 
+FileDescriptorCache::FileDescriptorCache(size_t capacity) : m_capacity(capacity)
+{
 }
 
 FileDescriptorCache::~FileDescriptorCache()
 {
-	// TODO Auto-generated destructor stub
+	// No Leases can be outstanding at this point.
+	for(auto &entry : m_lru_list)
+	{
+		close(entry.m_fd);
+	}
+}
+
+void FileDescriptorCache::SetCapacity(size_t capacity)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	m_capacity = capacity;
+	EvictExcess();
+}
+
+size_t FileDescriptorCache::GetCapacity() const noexcept
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	return m_capacity;
 }
 
+FileDescriptorCache::Lease FileDescriptorCache::Acquire(uint64_t key)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	auto it = m_map.find(key);
+	if(it == m_map.end())
+	{
+		m_misses++;
+		return Lease();
+	}
+
+	m_hits++;
+
+	// Move it to the front of the LRU list.
+	m_lru_list.splice(m_lru_list.begin(), m_lru_list, it->second);
+	it->second->m_pin_count++;
+
+	return Lease(this, key, it->second->m_fd);
+}
+
+void FileDescriptorCache::Insert(uint64_t key, int fd)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if(m_capacity == 0 || m_map.count(key) != 0)
+	{
+		// Either we're disabled, or another thread beat us to it.
+		close(fd);
+		return;
+	}
+
+	m_lru_list.push_front({key, fd, 0});
+	m_map.emplace(key, m_lru_list.begin());
+
+	EvictExcess();
+
+	if(m_lru_list.size() > m_max_open)
+	{
+		m_max_open = m_lru_list.size();
+	}
+}
+
+void FileDescriptorCache::Release(uint64_t key) noexcept
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	auto it = m_map.find(key);
+	if(it != m_map.end())
+	{
+		it->second->m_pin_count--;
+	}
+
+	// If we're over capacity because everything was pinned, this may be our chance to catch up.
+	EvictExcess();
+}
+
+void FileDescriptorCache::EvictExcess() noexcept
+{
+	// Walk from the least recently used end, skipping anything that's pinned.
+	auto rit = m_lru_list.rbegin();
+	while(m_lru_list.size() > m_capacity && rit != m_lru_list.rend())
+	{
+		if(rit->m_pin_count > 0)
+		{
+			++rit;
+			continue;
+		}
+
+		close(rit->m_fd);
+		m_map.erase(rit->m_key);
+		// Erasing via a reverse_iterator: erase the element it refers to, and get a reverse_iterator to the next one.
+		rit = std::list<Entry>::reverse_iterator(m_lru_list.erase(std::next(rit).base()));
+		m_evictions++;
+	}
+}
+
+std::ostream& operator<<(std::ostream& os, const FileDescriptorCache &fdc)
+{
+	return os << "Directory descriptor cache capacity: " << fdc.GetCapacity() << "\n"
+			<< "Directory descriptor cache hits: " << fdc.m_hits << "\n"
+			<< "Directory descriptor cache misses: " << fdc.m_misses << "\n"
+			<< "Directory descriptor cache evictions: " << fdc.m_evictions << "\n"
+			<< "Directory descriptor cache max open: " << fdc.m_max_open << "\n";
+}
@@ -22,21 +22,119 @@
 
 #include <config.h>
 
-#include "FileDescriptor.hpp"
-#include "filesystem.hpp"
+#include <cstdint>
+#include <cstddef>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <iosfwd>
 
-/*
+/**
+ * Thread-safe, bounded, least-recently-used cache of directory file descriptors.
+ *
+ * Directory FileIDs insert a descriptor for themselves when they're opened for reading, and anything which needs to
+ * open or stat a file in that directory can then use it with openat()/fstatat() instead of resolving the full path.
+ * At most GetCapacity() descriptors are kept open; beyond that, the least recently used descriptor which isn't
+ * in use is closed.
  *
+ * Entries are keyed by a number unique to each directory FileID over the life of the process, so a key is never reused
+ * for a different directory.
  */
 class FileDescriptorCache
 {
 public:
-	FileDescriptorCache();
+	/// Default maximum number of descriptors to keep open.
+	static constexpr size_t cm_default_capacity = 256;
+
+	/**
+	 * RAII "pin" on a cached file descriptor.  While a Lease exists, its descriptor won't be closed by an eviction.
+	 */
+	class Lease
+	{
+	public:
+		Lease() noexcept = default;
+		Lease(const Lease&) = delete;
+		Lease(Lease&& other) noexcept : m_cache(other.m_cache), m_key(other.m_key), m_fd(other.m_fd) { other.m_cache = nullptr; other.m_fd = -1; };
+		Lease& operator=(const Lease&) = delete;
+		Lease& operator=(Lease&& other) = delete;
+		~Lease() noexcept { if(m_cache != nullptr) { m_cache->Release(m_key); } };
+
+		/// The leased file descriptor, or -1 if the lookup missed.
+		[[nodiscard]] int GetFD() const noexcept { return m_fd; };
+
+		[[nodiscard]] bool empty() const noexcept { return m_fd < 0; };
+
+	private:
+		friend class FileDescriptorCache;
+		Lease(FileDescriptorCache *cache, uint64_t key, int fd) noexcept : m_cache(cache), m_key(key), m_fd(fd) {};
+
+		FileDescriptorCache *m_cache {nullptr};
+		uint64_t m_key {0};
+		int m_fd {-1};
+	};
+
+	explicit FileDescriptorCache(size_t capacity = cm_default_capacity);
 	~FileDescriptorCache();
 
+	FileDescriptorCache(const FileDescriptorCache&) = delete;
+	FileDescriptorCache& operator=(const FileDescriptorCache&) = delete;
+
+	/**
+	 * Set the maximum number of descriptors to keep open.  Evicts as necessary.
+	 * A capacity of 0 disables the cache; Insert() will then close the descriptors passed to it.
+	 */
+	void SetCapacity(size_t capacity);
+
+	[[nodiscard]] size_t GetCapacity() const noexcept;
+
+	/**
+	 * Look up the descriptor for @a key and pin it.
+	 *
+	 * @returns  A Lease on the descriptor, which will be empty() on a miss.
+	 */
+	Lease Acquire(uint64_t key);
+
+	/**
+	 * Add @a fd to the cache under @a key, taking ownership of it.  If there's already an entry for @a key, @a fd is closed.
+	 */
+	void Insert(uint64_t key, int fd);
+
+	/// Stream insertion of the hit/miss/eviction stats.
+	friend std::ostream& operator<<(std::ostream& os, const FileDescriptorCache &fdc);
+
 private:
 
+	/// Called by ~Lease().
+	void Release(uint64_t key) noexcept;
+
+	/// Close unpinned least-recently-used descriptors until we're within capacity.  m_mutex must be held.
+	void EvictExcess() noexcept;
+
+	struct Entry
+	{
+		uint64_t m_key;
+		int m_fd;
+		/// Number of outstanding Leases on this descriptor.
+		int m_pin_count;
+	};
+
+	mutable std::mutex m_mutex;
+
+	size_t m_capacity;
+
+	/// Most recently used at the front.
+	std::list<Entry> m_lru_list;
+
+	std::unordered_map<uint64_t, std::list<Entry>::iterator> m_map;
 
+	/// @name Stats.
+	/// @{
+	std::atomic<uint64_t> m_hits {0};
+	std::atomic<uint64_t> m_misses {0};
+	std::atomic<uint64_t> m_evictions {0};
+	std::atomic<uint64_t> m_max_open {0};
+	/// @}
 };
 
 #endif /* SRC_LIBEXT_FILEDESCRIPTORCACHE_H_ */
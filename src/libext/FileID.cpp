@@ -30,6 +30,7 @@
 #include <sys/stat.h>
 
 #include "DoubleCheckedLock.hpp"
+#include "FileDescriptorCache.h"
 
 #define M_ENABLE_FD_STATS 0
 
@@ -75,12 +76,21 @@ public:
 
 	FileID::IsValid GetFileDescriptor();
 
+	/**
+	 * open() this file with @a flags.  If our at-dir has a descriptor in the directory descriptor cache, the file is
+	 * openat() that descriptor with just our basename, otherwise it's open()ed by path.
+	 *
+	 * @returns  The new file descriptor, or -1 with errno set.
+	 */
+	int OpenViaAtDir(int flags) const noexcept;
+
 //protected:
 	static std::ostream& dump_stats(std::ostream &ostrm, const FileID::impl &impl)
 	{
 		return ostrm << "Max descriptors, regular: " << FileID::impl::m_atomic_fd_max_reg << "\n"
 				<< "Max descriptors, dir: " << FileID::impl::m_atomic_fd_max_dir << "\n"
-				<< "Max descriptors, other: " << FileID::impl::m_atomic_fd_max_other << "\n";
+				<< "Max descriptors, other: " << FileID::impl::m_atomic_fd_max_other << "\n"
+				<< FileID::impl::m_dir_fd_cache;
 	}
 
 	int GetTempDirFileDesc() const noexcept;
@@ -120,6 +130,9 @@ public:
 	/// the subsequent call to CloseDir().  Used for caching the AT-dir descriptor for FStatAt().
 	mutable int m_temp_dir_file_descriptor = -987;
 
+	/// Key for this directory's entry in m_dir_fd_cache.  Unique to this FileID (and any copies of it) for the life of the process.
+	uint64_t m_dir_cache_key { m_next_dir_cache_key++ };
+
 	/// @name Info normally gathered from a stat() call.
 	///@{
 	mutable FileType m_file_type { FT_UNINITIALIZED };
@@ -144,6 +157,12 @@ public:
 	static std::atomic<std::uint64_t> m_atomic_fd_max_reg;
 	static std::atomic<std::uint64_t> m_atomic_fd_max_dir;
 	static std::atomic<std::uint64_t> m_atomic_fd_max_other;
+
+	/// Source of m_dir_cache_keys.
+	static std::atomic<std::uint64_t> m_next_dir_cache_key;
+
+	/// Cache of open directory descriptors, shared by all FileIDs.
+	static FileDescriptorCache m_dir_fd_cache;
 };
 
 /// @name Compile-time invariants for the FileID::impl class.
@@ -195,6 +214,8 @@ const std::string& FileID::impl::GetBasename() const noexcept
 std::atomic<std::uint64_t> FileID::impl::m_atomic_fd_max_reg;
 std::atomic<std::uint64_t> FileID::impl::m_atomic_fd_max_dir;
 std::atomic<std::uint64_t> FileID::impl::m_atomic_fd_max_other;
+std::atomic<std::uint64_t> FileID::impl::m_next_dir_cache_key {1};
+FileDescriptorCache FileID::impl::m_dir_fd_cache;
 
 FileID::IsValid FileID::impl::GetFileDescriptor()
 {
@@ -231,12 +252,10 @@ FileID::IsValid FileID::impl::GetFileDescriptor()
 
 		if(m_at_dir)
 		{
-			int tempfd = -1;
-
-			ResolvePath();
-			tempfd = open(m_path.c_str(), m_open_flags);
+			int tempfd = OpenViaAtDir(m_open_flags);
 			if(unlikely(tempfd == -1))
 			{
+				ResolvePath();
 				throw FileException("GetFileDescriptor(): open(" + m_path + ") failed");
 			}
 
@@ -244,7 +263,8 @@ FileID::IsValid FileID::impl::GetFileDescriptor()
 		}
 	}
 
-	return FileID::FILE_DESC | FileID::PATH;
+	// Note: We may have opened the file relative to a cached at-dir descriptor, so the path isn't necessarily resolved.
+	return FileID::FILE_DESC;
 }
 
 void FileID::impl::SetDevIno(dev_t d, ino_t i) noexcept
@@ -269,14 +289,41 @@ int FileID::impl::GetTempDirFileDesc() const noexcept
 		else
 		{
 			// Create a new temp file descriptor.
-			ResolvePath();
-			m_temp_dir_file_descriptor = open(m_path.c_str(), O_RDONLY | O_NOATIME | O_NOCTTY | O_DIRECTORY);
+			m_temp_dir_file_descriptor = OpenViaAtDir(O_RDONLY | O_NOATIME | O_NOCTTY | O_DIRECTORY);
+
+			if(m_temp_dir_file_descriptor >= 0)
+			{
+				// Cache a descriptor for this directory, so the files and directories in it can be opened relative to it.
+				// This has to be a separate descriptor from the one which will be given to fdopendir().
+				int cache_fd = dup(m_temp_dir_file_descriptor);
+				if(cache_fd >= 0)
+				{
+					m_dir_fd_cache.Insert(m_dir_cache_key, cache_fd);
+				}
+			}
 		}
 	}
 
 	return m_temp_dir_file_descriptor;
 }
 
+int FileID::impl::OpenViaAtDir(int flags) const noexcept
+{
+	if(m_at_dir && !is_pathname_absolute(m_basename))
+	{
+		// Hold the lease until the openat() is done, so the at-dir descriptor can't be closed out from under us.
+		FileDescriptorCache::Lease at_dir_fd = m_dir_fd_cache.Acquire(m_at_dir->m_pimpl->m_dir_cache_key);
+		if(!at_dir_fd.empty())
+		{
+			return openat(at_dir_fd.GetFD(), m_basename.c_str(), flags);
+		}
+	}
+
+	// No cached at-dir descriptor, open by path.
+	ResolvePath();
+	return open(m_path.c_str(), flags);
+}
+
 FileID::IsValid FileID::impl::LazyLoadStatInfo() const noexcept
 {
 	// We don't have stat info and now we need it.
@@ -629,6 +676,11 @@ void FileID::SetDevIno(dev_t d, ino_t i) noexcept
 			[&](){ m_pimpl->SetDevIno(d, i); return UUID; });
 }
 
+void FileID::SetDirDescriptorCacheCapacity(size_t capacity)
+{
+	FileID::impl::m_dir_fd_cache.SetCapacity(capacity);
+}
+
 std::ostream& operator<<(std::ostream &ostrm, const FileID &fileid)
 {
 	fileid.m_pimpl->dump_stats(ostrm, *fileid.m_pimpl);
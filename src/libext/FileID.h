@@ -101,6 +101,16 @@ constexpr inline FileCreationFlag operator|(FileCreationFlag a, FileCreationFlag
 			| static_cast<std::underlying_type<FileCreationFlag>::type>(b));
 }
 
+/**
+ * Order in which the files found in a single directory are handed off to be read.
+ */
+enum FileReadOrder : int
+{
+	FRO_READDIR,	//!< The order readdir() returned them in.
+	FRO_INODE,		//!< Ascending inode number.
+	FRO_EXTENT		//!< Ascending physical location of each file's first extent, if available, else by inode.
+};
+
 
 /**
  * The public interface to the underlying FileID::impl instance.  This class adds thread safety.
@@ -256,6 +266,12 @@ public:
 
 	void SetDevIno(dev_t d, ino_t i) noexcept;
 
+	/**
+	 * Set the maximum number of directory descriptors which will be kept open so that files and directories
+	 * can be opened relative to their parent directory.  0 disables this.
+	 */
+	static void SetDirDescriptorCacheCapacity(size_t capacity);
+
 	friend std::ostream& operator<<(std::ostream &ostrm, const FileID &fileid);
 
 private:
@@ -36,6 +36,11 @@ static uint32_t eax, ebx, ecx, edx;
 
 static bool CPUID_info_valid = false;
 
+// Results of CPUID leaf 7, subleaf 0 (structured extended feature flags).
+static uint32_t eax7, ebx7, ecx7, edx7;
+
+static bool CPUID7_info_valid = false;
+
 
 static void GetCPUIDInfo() noexcept
 {
@@ -53,6 +58,23 @@ static void GetCPUIDInfo() noexcept
 #endif
 }
 
+static void GetCPUID7Info() noexcept
+{
+#if defined(__x86_64__)
+	if(!CPUID7_info_valid)
+	{
+		// __get_cpuid_count() checks that leaf 7 exists, and leaves the regs alone and returns 0 if it doesn't.
+		if(__get_cpuid_count(7, 0, &eax7, &ebx7, &ecx7, &edx7) == 0)
+		{
+			eax7 = ebx7 = ecx7 = edx7 = 0;
+		}
+		CPUID7_info_valid = true;
+	}
+#else
+	CPUID7_info_valid = false;
+#endif
+}
+
 bool sys_has_sse2() noexcept
 {
 	GetCPUIDInfo();
@@ -87,6 +109,11 @@ static uint32_t get_xgetbv(uint32_t xcr) {
 static const uint32_t XCR_XFEATURE_ENABLED_MASK = 0;
 #endif
 
+/// XCR0 bits which must be set for the OS to be saving the XMM and YMM registers.
+static constexpr uint32_t f_xcr0_xmm_ymm = 0x6;
+/// XCR0 bits which must be set for the OS to be saving the XMM, YMM, opmask, and ZMM registers.
+static constexpr uint32_t f_xcr0_xmm_ymm_zmm = 0xE6;
+
 bool sys_has_avx() noexcept
 {
 	bool supported = false;
@@ -100,7 +127,7 @@ bool sys_has_avx() noexcept
 			// OS has enabled XGETBV.
 			// Check if OS has enabled XMM and YMM state saving support.
 			auto feature_mask = get_xgetbv(XCR_XFEATURE_ENABLED_MASK);
-			if((feature_mask & 0x6) == 0x6)
+			if((feature_mask & f_xcr0_xmm_ymm) == f_xcr0_xmm_ymm)
 			{
 				supported = true;
 			}
@@ -110,3 +137,30 @@ bool sys_has_avx() noexcept
 	return supported;
 }
 
+bool sys_has_avx2() noexcept
+{
+	GetCPUID7Info();
+
+	// The OS has to support the AVX state, which sys_has_avx() checks.
+	return sys_has_avx() && (ebx7 & bit_AVX2);
+}
+
+bool sys_has_avx512bw() noexcept
+{
+	bool supported = false;
+
+	GetCPUIDInfo();
+	GetCPUID7Info();
+	if((ebx7 & bit_AVX512F) && (ebx7 & bit_AVX512BW) && (ecx & bit_OSXSAVE))
+	{
+		// CPU supports AVX-512F and BW, and the OS has enabled XGETBV.
+		// Check if the OS has enabled the opmask and ZMM state as well as XMM and YMM.
+		auto feature_mask = get_xgetbv(XCR_XFEATURE_ENABLED_MASK);
+		if((feature_mask & f_xcr0_xmm_ymm_zmm) == f_xcr0_xmm_ymm_zmm)
+		{
+			supported = true;
+		}
+	}
+
+	return supported;
+}
@@ -28,6 +28,8 @@ bool sys_has_sse2() noexcept;
 bool sys_has_sse4_2() noexcept;
 bool sys_has_popcnt() noexcept;
 bool sys_has_avx() noexcept;
+bool sys_has_avx2() noexcept;
+bool sys_has_avx512bw() noexcept;
 /// @}
 
 #endif /* SRC_LIBEXT_CPUIDEX_HPP_ */
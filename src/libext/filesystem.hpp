@@ -154,6 +154,8 @@ struct dev_ino_pair
 
 	[[nodiscard]] inline bool empty() const noexcept { return m_dev == 0 && m_ino == 0; };
 
+	[[nodiscard]] constexpr ino_t ino() const noexcept { return m_ino; };
+
 private:
 	friend struct std::hash<dev_ino_pair>;
 
@@ -28,6 +28,11 @@
 
 /// @name MULTIVERSION_DECORATOR_<FEATURE> function definition decorators
 ///@{
+#if defined(__AVX512BW__)
+#define MULTIVERSION_DECORATOR_AVX512BW	_avx512bw
+#elif defined(__AVX2__)
+#define MULTIVERSION_DECORATOR_AVX2		_avx2
+#endif
 #if defined(__SSE2__) || __SSE2__==1
 #define MULTIVERSION_DECORATOR_SSE2		_sse2
 #endif
@@ -43,7 +48,11 @@
 #endif
 ///@}
 
-#if defined(MULTIVERSION_DECORATOR_SSE4_2)
+#if defined(MULTIVERSION_DECORATOR_AVX512BW)
+#define MULTIVERSION(funcname) TOKEN_APPEND(funcname, MULTIVERSION_DECORATOR_AVX512BW)
+#elif defined(MULTIVERSION_DECORATOR_AVX2)
+#define MULTIVERSION(funcname) TOKEN_APPEND(funcname, MULTIVERSION_DECORATOR_AVX2)
+#elif defined(MULTIVERSION_DECORATOR_SSE4_2)
 #define MULTIVERSION(funcname) TOKEN_APPEND(TOKEN_APPEND(funcname, MULTIVERSION_DECORATOR_SSE4_2), MULTIVERSION_DECORATOR_POPCNT)
 #elif defined(MULTIVERSION_DECORATOR_SSE2)
 #define MULTIVERSION(funcname) TOKEN_APPEND(funcname, MULTIVERSION_DECORATOR_SSE2)
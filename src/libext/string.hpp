@@ -65,6 +65,33 @@ inline std::vector<std::string> split(const std::string &s, char delimiter)
 }
 
 
+/**
+ * Locale-independent tolower() which only folds the ASCII letters.  This is the same case folding libpcre2 does
+ * with its default character tables and UTF/UCP off.
+ */
+constexpr char ascii_tolower(char c) noexcept
+{
+	return (c >= 'A' && c <= 'Z') ? static_cast<char>(c | 0x20) : c;
+}
+
+/**
+ * Compares the #len chars at #s with those at #lower, ignoring ASCII case.  #lower must already be in lowercase.
+ *
+ * @return  true if they are equal.
+ */
+inline bool ascii_caseless_equal(const char * __restrict__ s, const char * __restrict__ lower, size_t len) noexcept
+{
+	for(size_t i=0; i<len; ++i)
+	{
+		if(ascii_tolower(s[i]) != lower[i])
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+
 /**
  * Joins the strings in #container_of_strings into a single string, optionally separated by #separator.
  *
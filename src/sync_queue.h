@@ -246,6 +246,27 @@ public:
 		return queue_op_status::success;
 	}
 
+	/**
+	 * Non-blocking pull.  If there's something in the queue, moves it into @p x and returns queue_op_status::success.
+	 * Otherwise returns queue_op_status::empty, or queue_op_status::closed if the queue is also closed.
+	 *
+	 * @note Unlike pull_front(), this doesn't count as a waiting thread for wait_for_worker_completion()'s purposes.
+	 */
+	queue_op_status try_pull_front(ValueType& x) ATTR_NOINLINE
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+
+		if(m_underlying_queue.empty())
+		{
+			return m_closed ? queue_op_status::closed : queue_op_status::empty;
+		}
+
+		x = std::move(m_underlying_queue.front());
+		m_underlying_queue.pop_front();
+
+		return queue_op_status::success;
+	}
+
 	/**
 	 *  Blocks the calling thread until:
 	 *	 - The queue is empty, and